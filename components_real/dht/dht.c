@@ -45,6 +45,14 @@
 #include <esp_log.h>
 #include <ets_sys.h>
 #include <esp_idf_lib_helpers.h>
+#if HELPER_TARGET_IS_ESP32
+#include <stdlib.h>
+#include <freertos/semphr.h>
+#include <driver/rmt_rx.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <soc/soc_caps.h>
+#endif
 
 // DHT timer precision in microseconds
 #define DHT_TIMER_INTERVAL 2
@@ -257,3 +265,363 @@ esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
 
     return ESP_OK;
 }
+
+#if HELPER_TARGET_IS_ESP32
+
+/*
+ * RMT read path. Phase 'A' is timed by an esp_timer with the line held
+ * low, then the RMT receiver is armed and the line released. Phases B-D
+ * and the 40 bits are captured in hardware as (level, duration) pairs and
+ * decoded in the RX done ISR. Nothing waits in a critical section.
+ */
+
+#define DHT_RMT_RESOLUTION_HZ 1000000  // 1 tick = 1 us
+#define DHT_RMT_MIN_PULSE_NS  1000     // shorter pulses are glitches
+#define DHT_RMT_IDLE_US       200      // line high this long ends the reply
+#define DHT_RMT_TIMEOUT_US    10000    // reply takes ~4.5 ms
+#define DHT_RMT_SYMBOLS       64       // reply is ~43 symbols
+
+enum { DHT_RMT_IDLE = 0, DHT_RMT_START, DHT_RMT_CAPTURE };
+
+struct dht_rmt_s
+{
+    dht_sensor_type_t type;
+    gpio_num_t pin;
+    rmt_channel_handle_t chan;
+    esp_timer_handle_t timer;
+    volatile uint8_t phase;
+    bool pending;                // a result is owed to cb
+    dht_rmt_cb_t cb;
+    void *arg;
+    SemaphoreHandle_t done;      // dht_rmt_read() only
+    esp_err_t res;
+    int16_t humidity, temperature;
+    rmt_symbol_word_t sym[DHT_RMT_SYMBOLS];
+};
+
+/*
+ * Only high pulses carry data: a bit is 1 when its high outlasts the low
+ * before it, as in dht_fetch_data(). The last 40 highs are the bits, so
+ * whatever the capture caught of the release and phases B-D is skipped.
+ */
+static esp_err_t dht_rmt_decode(const rmt_symbol_word_t *sym, size_t n, uint8_t data[DHT_DATA_BYTES])
+{
+    uint64_t bits = 0;
+    uint32_t highs = 0, low = 0;
+
+    for (size_t i = 0; i < 2 * n; i++)
+    {
+        uint32_t level = i & 1 ? sym[i / 2].level1 : sym[i / 2].level0;
+        uint32_t dur = i & 1 ? sym[i / 2].duration1 : sym[i / 2].duration0;
+        if (!dur)
+            break;  // end marker
+        if (!level)
+        {
+            low = dur;
+            continue;
+        }
+        bits = (bits << 1) | (dur > low);
+        highs++;
+        low = 0;
+    }
+
+    // the response high of phase 'C' plus 40 bits
+    if (highs < DHT_DATA_BITS + 1)
+        return ESP_ERR_INVALID_RESPONSE;
+
+    for (int b = 0; b < DHT_DATA_BYTES; b++)
+        data[b] = bits >> (8 * (DHT_DATA_BYTES - 1 - b));
+
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF))
+        return ESP_ERR_INVALID_CRC;
+
+    return ESP_OK;
+}
+
+// the first caller wins; a late ISR or timer finds nothing owed
+static bool dht_rmt_finish(dht_rmt_handle_t dht, esp_err_t res, int16_t humidity, int16_t temperature)
+{
+    if (!__atomic_exchange_n(&dht->pending, false, __ATOMIC_ACQ_REL))
+        return false;
+    dht->phase = DHT_RMT_IDLE;
+    return dht->cb ? dht->cb(res, humidity, temperature, dht->arg) : false;
+}
+
+static bool dht_rmt_rx_done(rmt_channel_handle_t chan, const rmt_rx_done_event_data_t *edata, void *ctx)
+{
+    dht_rmt_handle_t dht = ctx;
+    if (dht->phase != DHT_RMT_CAPTURE)
+        return false;
+
+    uint8_t data[DHT_DATA_BYTES];
+    esp_err_t res = dht_rmt_decode(edata->received_symbols, edata->num_symbols, data);
+    if (res != ESP_OK)
+        return dht_rmt_finish(dht, res, 0, 0);
+
+    return dht_rmt_finish(dht, ESP_OK,
+            dht_convert_data(dht->type, data[0], data[1]),
+            dht_convert_data(dht->type, data[2], data[3]));
+}
+
+static void dht_rmt_timer(void *arg)
+{
+    dht_rmt_handle_t dht = arg;
+
+    if (dht->phase == DHT_RMT_START)
+    {
+        // arm first: the sensor answers 20-40 us after the release
+        rmt_receive_config_t rc = {
+            .signal_range_min_ns = DHT_RMT_MIN_PULSE_NS,
+            .signal_range_max_ns = DHT_RMT_IDLE_US * 1000,
+        };
+        dht->phase = DHT_RMT_CAPTURE;
+        esp_err_t res = rmt_receive(dht->chan, dht->sym, sizeof(dht->sym), &rc);
+        gpio_set_level(dht->pin, 1);
+        if (res != ESP_OK)
+        {
+            dht_rmt_finish(dht, res, 0, 0);
+            return;
+        }
+        esp_timer_start_once(dht->timer, DHT_RMT_TIMEOUT_US);
+        return;
+    }
+
+    if (dht->phase != DHT_RMT_CAPTURE)
+        return;
+
+    // no reply: claim the result before stopping the armed receiver
+    if (!__atomic_exchange_n(&dht->pending, false, __ATOMIC_ACQ_REL))
+        return;
+    rmt_disable(dht->chan);
+    rmt_enable(dht->chan);
+    dht->phase = DHT_RMT_IDLE;
+    ESP_LOGW(TAG, "No reply on GPIO %d", dht->pin);
+    if (dht->cb)
+        dht->cb(ESP_ERR_TIMEOUT, 0, 0, dht->arg);
+}
+
+esp_err_t dht_rmt_new(dht_sensor_type_t sensor_type, gpio_num_t pin, dht_rmt_handle_t *out)
+{
+    CHECK_ARG(out);
+
+    // the RX buffer must be reachable by the RMT ISR
+    dht_rmt_handle_t dht = heap_caps_calloc(1, sizeof(*dht), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!dht)
+        return ESP_ERR_NO_MEM;
+    dht->type = sensor_type;
+    dht->pin = pin;
+
+    esp_err_t res;
+    rmt_rx_channel_config_t cfg = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL,
+    };
+    if ((res = rmt_new_rx_channel(&cfg, &dht->chan)) != ESP_OK)
+        goto fail;
+
+    rmt_rx_event_callbacks_t cbs = { .on_recv_done = dht_rmt_rx_done };
+    if ((res = rmt_rx_register_event_callbacks(dht->chan, &cbs, dht)) != ESP_OK)
+        goto fail;
+
+    const esp_timer_create_args_t targs = {
+        .callback = dht_rmt_timer,
+        .arg = dht,
+        .name = "dht_rmt",
+    };
+    if ((res = esp_timer_create(&targs, &dht->timer)) != ESP_OK)
+        goto fail;
+
+    // the RX channel routed the pin as input; also let us drive it open-drain
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_pull_mode(pin, GPIO_PULLUP_ONLY);
+    gpio_set_level(pin, 1);
+
+    if ((res = rmt_enable(dht->chan)) != ESP_OK)
+        goto fail;
+
+    *out = dht;
+    return ESP_OK;
+
+fail:
+    ESP_LOGE(TAG, "RMT setup on GPIO %d failed: %d", pin, res);
+    if (dht->timer)
+        esp_timer_delete(dht->timer);
+    if (dht->chan)
+        rmt_del_channel(dht->chan);
+    free(dht);
+    return res;
+}
+
+esp_err_t dht_rmt_del(dht_rmt_handle_t dht)
+{
+    CHECK_ARG(dht);
+    if (dht->pending)
+        return ESP_ERR_INVALID_STATE;
+
+    esp_timer_stop(dht->timer);
+    esp_timer_delete(dht->timer);
+    rmt_disable(dht->chan);
+    rmt_del_channel(dht->chan);
+    if (dht->done)
+        vSemaphoreDelete(dht->done);
+    free(dht);
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_start(dht_rmt_handle_t dht, dht_rmt_cb_t cb, void *arg)
+{
+    CHECK_ARG(dht && cb);
+    if (dht->pending)
+        return ESP_ERR_INVALID_STATE;
+
+    // a timeout left over from a read the ISR completed
+    esp_timer_stop(dht->timer);
+
+    dht->cb = cb;
+    dht->arg = arg;
+    dht->pending = true;
+    dht->phase = DHT_RMT_START;
+
+    // Phase 'A'
+    gpio_set_level(dht->pin, 0);
+    esp_err_t res = esp_timer_start_once(dht->timer, dht->type == DHT_TYPE_SI7021 ? 500 : 20000);
+    if (res != ESP_OK)
+    {
+        gpio_set_level(dht->pin, 1);
+        dht->pending = false;
+        dht->phase = DHT_RMT_IDLE;
+    }
+    return res;
+}
+
+static bool dht_rmt_read_done(esp_err_t res, int16_t humidity, int16_t temperature, void *arg)
+{
+    dht_rmt_handle_t dht = arg;
+    BaseType_t woken = pdFALSE;
+
+    dht->res = res;
+    dht->humidity = humidity;
+    dht->temperature = temperature;
+    if (xPortInIsrContext())
+        xSemaphoreGiveFromISR(dht->done, &woken);
+    else
+        xSemaphoreGive(dht->done);
+    return woken == pdTRUE;
+}
+
+esp_err_t dht_rmt_read(dht_rmt_handle_t dht, int16_t *humidity, int16_t *temperature)
+{
+    CHECK_ARG(dht && (humidity || temperature));
+
+    if (!dht->done && !(dht->done = xSemaphoreCreateBinary()))
+        return ESP_ERR_NO_MEM;
+
+    esp_err_t res = dht_rmt_start(dht, dht_rmt_read_done, dht);
+    if (res != ESP_OK)
+        return res;
+
+    // the timeout path guarantees a completion
+    xSemaphoreTake(dht->done, portMAX_DELAY);
+    if (dht->res != ESP_OK)
+        return dht->res;
+
+    if (humidity)
+        *humidity = dht->humidity;
+    if (temperature)
+        *temperature = dht->temperature;
+
+    ESP_LOGD(TAG, "Sensor data: humidity=%d, temp=%d", dht->humidity, dht->temperature);
+
+    return ESP_OK;
+}
+
+struct dht_rmt_group_s;
+
+typedef struct
+{
+    struct dht_rmt_group_s *group;
+    size_t idx;
+} dht_rmt_member_t;
+
+struct dht_rmt_group_s
+{
+    dht_rmt_handle_t dht[DHT_RMT_GROUP_MAX];
+    dht_rmt_member_t member[DHT_RMT_GROUP_MAX];   // per-sensor callback arguments
+    size_t n;
+    uint32_t left;               // results still owed, 0 when idle
+    dht_rmt_group_cb_t cb;
+    void *arg;
+    dht_rmt_result_t res[DHT_RMT_GROUP_MAX];
+};
+
+// whoever drops the count to zero reports the group
+static bool dht_rmt_group_release(dht_rmt_group_handle_t group)
+{
+    if (__atomic_sub_fetch(&group->left, 1, __ATOMIC_ACQ_REL))
+        return false;
+    return group->cb(group->res, group->n, group->arg);
+}
+
+static bool dht_rmt_group_done(esp_err_t res, int16_t humidity, int16_t temperature, void *arg)
+{
+    dht_rmt_member_t *m = arg;
+    m->group->res[m->idx] = (dht_rmt_result_t){ .res = res, .humidity = humidity, .temperature = temperature };
+    return dht_rmt_group_release(m->group);
+}
+
+esp_err_t dht_rmt_group_new(const dht_rmt_handle_t *dhts, size_t n, dht_rmt_group_handle_t *out)
+{
+    CHECK_ARG(dhts && out && n && n <= DHT_RMT_GROUP_MAX);
+
+    // results are written from the RMT ISR
+    dht_rmt_group_handle_t group = heap_caps_calloc(1, sizeof(*group), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!group)
+        return ESP_ERR_NO_MEM;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!dhts[i])
+        {
+            free(group);
+            return ESP_ERR_INVALID_ARG;
+        }
+        group->dht[i] = dhts[i];
+        group->member[i] = (dht_rmt_member_t){ .group = group, .idx = i };
+    }
+    group->n = n;
+    *out = group;
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_group_del(dht_rmt_group_handle_t group)
+{
+    CHECK_ARG(group);
+    if (__atomic_load_n(&group->left, __ATOMIC_ACQUIRE))
+        return ESP_ERR_INVALID_STATE;
+    free(group);
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_start_all(dht_rmt_group_handle_t group, dht_rmt_group_cb_t cb, void *arg)
+{
+    CHECK_ARG(group && cb);
+    if (__atomic_load_n(&group->left, __ATOMIC_ACQUIRE))
+        return ESP_ERR_INVALID_STATE;
+
+    group->cb = cb;
+    group->arg = arg;
+    // one count more than the sensors, held until all are started, so an
+    // early failure can't report the group before the rest are running
+    __atomic_store_n(&group->left, group->n + 1, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < group->n; i++)
+    {
+        esp_err_t res = dht_rmt_start(group->dht[i], dht_rmt_group_done, &group->member[i]);
+        if (res != ESP_OK)
+            dht_rmt_group_done(res, 0, 0, &group->member[i]);
+    }
+    dht_rmt_group_release(group);
+    return ESP_OK;
+}
+
+#endif
@@ -46,8 +46,11 @@
 #ifndef __DHT_H__
 #define __DHT_H__
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <driver/gpio.h>
 #include <esp_err.h>
+#include <esp_idf_lib_helpers.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -92,6 +95,147 @@ esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
 esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
         float *humidity, float *temperature);
 
+#if HELPER_TARGET_IS_ESP32
+
+/**
+ * Sensor read through the RMT receiver, see dht_rmt_new()
+ */
+typedef struct dht_rmt_s *dht_rmt_handle_t;
+
+/**
+ * Read completion callback
+ *
+ * Called once per dht_rmt_start(), from the RMT ISR when a reply was
+ * captured, or from the esp_timer task when the sensor did not answer.
+ *
+ * @param res `ESP_OK`, `ESP_ERR_TIMEOUT`, `ESP_ERR_INVALID_RESPONSE`
+ *            (reply too short) or `ESP_ERR_INVALID_CRC`
+ * @param humidity Humidity, percents * 10, valid if `res` is `ESP_OK`
+ * @param temperature Temperature, degrees Celsius * 10, valid if `res` is `ESP_OK`
+ * @param arg Argument given to dht_rmt_start()
+ * @return true if a higher priority task was woken
+ */
+typedef bool (*dht_rmt_cb_t)(esp_err_t res, int16_t humidity, int16_t temperature, void *arg);
+
+/**
+ * @brief Set up a sensor for RMT reads
+ *
+ * Takes one RMT RX channel and one esp_timer. The start pulse is timed
+ * by the esp_timer and the reply is captured by the RMT in hardware,
+ * then decoded, so a read never spins or masks interrupts.
+ *
+ * @param sensor_type DHT11 or DHT22
+ * @param pin GPIO pin connected to sensor OUT
+ * @param[out] out Sensor handle
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_rmt_new(dht_sensor_type_t sensor_type, gpio_num_t pin, dht_rmt_handle_t *out);
+
+/**
+ * @brief Release the RMT channel and timer of a sensor
+ *
+ * @param dht Sensor handle, no read may be in progress
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_rmt_del(dht_rmt_handle_t dht);
+
+/**
+ * @brief Start an asynchronous read
+ *
+ * Returns right after pulling the line low; `cb` reports the result
+ * about 25 ms later (20 ms start pulse plus the 4-5 ms reply).
+ *
+ * @param dht Sensor handle
+ * @param cb Completion callback
+ * @param arg Callback argument
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if a read is in progress
+ */
+esp_err_t dht_rmt_start(dht_rmt_handle_t dht, dht_rmt_cb_t cb, void *arg);
+
+/**
+ * @brief Read a sensor, blocking the calling task until the read completes
+ *
+ * Same result as dht_read_data(), but the task sleeps on a semaphore
+ * while the hardware does the work.
+ *
+ * @param dht Sensor handle
+ * @param[out] humidity Humidity, percents * 10, nullable
+ * @param[out] temperature Temperature, degrees Celsius * 10, nullable
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_rmt_read(dht_rmt_handle_t dht, int16_t *humidity, int16_t *temperature);
+
+/**
+ * Most sensors in one group: RMT RX channels on the ESP32-S3
+ */
+#define DHT_RMT_GROUP_MAX 4
+
+/**
+ * Sensors read together, see dht_rmt_group_new()
+ */
+typedef struct dht_rmt_group_s *dht_rmt_group_handle_t;
+
+/**
+ * Result of one sensor in a group read
+ */
+typedef struct
+{
+    esp_err_t res;          //!< `ESP_OK` or the sensor's own error, as for dht_rmt_cb_t
+    int16_t humidity;       //!< Humidity, percents * 10, valid if `res` is `ESP_OK`
+    int16_t temperature;    //!< Temperature, degrees Celsius * 10, valid if `res` is `ESP_OK`
+} dht_rmt_result_t;
+
+/**
+ * Group completion callback
+ *
+ * Called once per dht_rmt_start_all(), after the last sensor of the group
+ * finished, from that sensor's RMT ISR or esp_timer task. If no sensor
+ * could be started it runs in the caller, before dht_rmt_start_all() returns.
+ *
+ * @param results One entry per sensor, in the order given to dht_rmt_group_new()
+ * @param n Number of sensors
+ * @param arg Argument given to dht_rmt_start_all()
+ * @return true if a higher priority task was woken
+ */
+typedef bool (*dht_rmt_group_cb_t)(const dht_rmt_result_t *results, size_t n, void *arg);
+
+/**
+ * @brief Group sensors for dht_rmt_start_all()
+ *
+ * Each sensor keeps its own RMT RX channel from dht_rmt_new(); the
+ * ESP32-C3 has two, the ESP32-S3 four.
+ *
+ * @param dhts Sensor handles, each at most once
+ * @param n Number of sensors, 1 to `DHT_RMT_GROUP_MAX`
+ * @param[out] out Group handle
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_rmt_group_new(const dht_rmt_handle_t *dhts, size_t n, dht_rmt_group_handle_t *out);
+
+/**
+ * @brief Free a group; the sensors themselves are not released
+ *
+ * @param group Group handle, no group read may be in progress
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_rmt_group_del(dht_rmt_group_handle_t group);
+
+/**
+ * @brief Start every sensor of a group at once
+ *
+ * The start pulses and captures of all sensors overlap, so the group
+ * takes about as long as one read (~25 ms). `cb` then reports every
+ * sensor's result, including the ones that could not be started.
+ *
+ * @param group Group handle
+ * @param cb Group completion callback
+ * @param arg Callback argument
+ * @return `ESP_OK` on success, `ESP_ERR_INVALID_STATE` if a group read is in progress
+ */
+esp_err_t dht_rmt_start_all(dht_rmt_group_handle_t group, dht_rmt_group_cb_t cb, void *arg);
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
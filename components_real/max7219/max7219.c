@@ -40,13 +40,14 @@
 #include "max7219.h"
 #include <string.h>
 #include <esp_log.h>
+#include <esp_attr.h>
 
 #include "max7219_priv.h"
 
 static const char *TAG = "max7219";
 
 #define ALL_CHIPS 0xff
-#define ALL_DIGITS 8
+#define ALL_DIGITS MAX7219_CHIP_DIGITS
 
 #define REG_DIGIT_0      (1 << 8)
 #define REG_DECODE_MODE  (9 << 8)
@@ -66,6 +67,24 @@ static inline uint16_t shuffle(uint16_t val)
     return (val >> 8) | (val << 8);
 }
 
+static esp_err_t reap_one(max7219_t *dev, TickType_t timeout);
+static void post_cb(spi_transaction_t *t);
+
+static esp_err_t transmit(max7219_t *dev, const uint16_t *buf)
+{
+    // spi_device_transmit() must not interleave with queued frames
+    while (dev->pending[0] || dev->pending[1])
+        CHECK(reap_one(dev, portMAX_DELAY));
+
+    spi_transaction_t t;
+    memset(&t, 0, sizeof(t));
+    t.length = dev->cascade_size * 16;
+    t.tx_buffer = buf;
+    dev->stats.transactions++;
+    dev->stats.bytes += dev->cascade_size * 2;
+    return spi_device_transmit(dev->spi_dev, &t);
+}
+
 static esp_err_t send(max7219_t *dev, uint8_t chip, uint16_t value)
 {
     uint16_t buf[MAX7219_MAX_CASCADE_SIZE] = { 0 };
@@ -76,11 +95,7 @@ static esp_err_t send(max7219_t *dev, uint8_t chip, uint16_t value)
     }
     else buf[chip] = shuffle(value);
 
-    spi_transaction_t t;
-    memset(&t, 0, sizeof(t));
-    t.length = dev->cascade_size * 16;
-    t.tx_buffer = buf;
-    return spi_device_transmit(dev->spi_dev, &t);
+    return transmit(dev, buf);
 }
 
 inline static uint8_t get_char(max7219_t *dev, char c)
@@ -122,8 +137,9 @@ esp_err_t max7219_init_desc(max7219_t *dev, spi_host_device_t host, uint32_t clo
     dev->spi_cfg.spics_io_num = cs_pin;
     dev->spi_cfg.clock_speed_hz = clock_speed_hz;
     dev->spi_cfg.mode = 0;
-    dev->spi_cfg.queue_size = 1;
+    dev->spi_cfg.queue_size = MAX7219_QUEUE_SIZE;
     dev->spi_cfg.flags = SPI_DEVICE_NO_DUMMY;
+    dev->spi_cfg.post_cb = post_cb;
 
     return spi_bus_add_device(host, &dev->spi_cfg, &dev->spi_dev);
 }
@@ -132,6 +148,8 @@ esp_err_t max7219_free_desc(max7219_t *dev)
 {
     CHECK_ARG(dev);
 
+    CHECK(max7219_flush_wait(dev, portMAX_DELAY));
+
     return spi_bus_remove_device(dev->spi_dev);
 }
 
@@ -217,6 +235,7 @@ esp_err_t max7219_set_digit(max7219_t *dev, uint8_t digit, uint8_t val)
     ESP_LOGV(TAG, "Chip %d, digit %d val 0x%02x", c, d, val);
 
     CHECK(send(dev, c, (REG_DIGIT_0 + ((uint16_t)d << 8)) | val));
+    dev->shadow[c][d] = val;
 
     return ESP_OK;
 }
@@ -229,6 +248,9 @@ esp_err_t max7219_clear(max7219_t *dev)
     for (uint8_t i = 0; i < ALL_DIGITS; i++)
         CHECK(send(dev, ALL_CHIPS, (REG_DIGIT_0 + ((uint16_t)i << 8)) | val));
 
+    memset(dev->shadow, val, sizeof(dev->shadow));
+    dev->shadow_valid = true;
+
     return ESP_OK;
 }
 
@@ -261,3 +283,172 @@ esp_err_t max7219_draw_image_8x8(max7219_t *dev, uint8_t pos, const void *image)
 
     return ESP_OK;
 }
+
+/**
+ * Pack a frame into one SPI word buffer per digit register.
+ * Chips whose register already holds the value, and digits beyond
+ * dev->digits, get a no-op word and keep their contents.
+ * The shadow is updated as if every returned row is sent.
+ * Returns a bitmask of the rows that need a transaction.
+ */
+static uint8_t pack_frame(max7219_t *dev, const uint8_t *fb,
+        uint16_t rows[ALL_DIGITS][MAX7219_MAX_CASCADE_SIZE])
+{
+    uint8_t dirty = 0;
+
+    for (uint8_t d = 0; d < ALL_DIGITS; d++)
+    {
+        memset(rows[d], 0, sizeof(rows[d]));
+        for (uint8_t c = 0; c < dev->cascade_size; c++)
+        {
+            uint8_t phys = c * ALL_DIGITS + d;
+            if (phys >= dev->digits)
+                continue;
+            uint8_t val = fb[dev->mirrored ? dev->digits - phys - 1 : phys];
+            if (dev->shadow_valid && dev->shadow[c][d] == val)
+            {
+                dev->stats.writes_saved++;
+                continue;
+            }
+            rows[d][c] = shuffle((REG_DIGIT_0 + ((uint16_t)d << 8)) | val);
+            dev->shadow[c][d] = val;
+            dirty |= 1 << d;
+        }
+        if (!(dirty & (1 << d)))
+        {
+            dev->stats.transactions_saved++;
+            dev->stats.bytes_saved += dev->cascade_size * 2;
+        }
+    }
+    dev->shadow_valid = true;
+
+    return dirty;
+}
+
+static esp_err_t reap_one(max7219_t *dev, TickType_t timeout)
+{
+    spi_transaction_t *t;
+    CHECK(spi_device_get_trans_result(dev->spi_dev, &t, timeout));
+    dev->pending[(t - &dev->trans[0][0]) / ALL_DIGITS]--;
+
+    return ESP_OK;
+}
+
+static esp_err_t wait_buffer(max7219_t *dev, uint8_t idx, TickType_t timeout)
+{
+    while (dev->pending[idx])
+        CHECK(reap_one(dev, timeout));
+
+    return ESP_OK;
+}
+
+static void IRAM_ATTR post_cb(spi_transaction_t *t)
+{
+    max7219_t *dev = (max7219_t *)t->user;
+    if (dev && dev->flush_cb)
+        dev->flush_cb(dev, dev->flush_arg);
+}
+
+esp_err_t max7219_draw_framebuffer(max7219_t *dev, const uint8_t *fb)
+{
+    CHECK_ARG(dev && fb);
+
+    uint16_t rows[ALL_DIGITS][MAX7219_MAX_CASCADE_SIZE];
+    uint8_t dirty = pack_frame(dev, fb, rows);
+
+    for (uint8_t d = 0; d < ALL_DIGITS; d++)
+    {
+        if (!(dirty & (1 << d)))
+            continue;
+        esp_err_t res = transmit(dev, rows[d]);
+        if (res != ESP_OK)
+        {
+            dev->shadow_valid = false;
+            return res;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t max7219_draw_framebuffer_async(max7219_t *dev, const uint8_t *fb, uint8_t *dirty_out)
+{
+    CHECK_ARG(dev && fb);
+    if (dirty_out)
+        *dirty_out = 0;
+
+    // The back buffer may still belong to the frame before the previous one
+    uint8_t idx = dev->back;
+    CHECK(wait_buffer(dev, idx, portMAX_DELAY));
+
+    uint8_t dirty = pack_frame(dev, fb, dev->txbuf[idx]);
+    int8_t last = -1;
+    for (uint8_t d = 0; d < ALL_DIGITS; d++)
+        if (dirty & (1 << d))
+            last = d;
+
+    for (uint8_t d = 0; d < ALL_DIGITS; d++)
+    {
+        if (!(dirty & (1 << d)))
+            continue;
+        spi_transaction_t *t = &dev->trans[idx][d];
+        memset(t, 0, sizeof(*t));
+        t->length = dev->cascade_size * 16;
+        t->tx_buffer = dev->txbuf[idx][d];
+        t->user = d == last ? dev : NULL;
+        esp_err_t res = spi_device_queue_trans(dev->spi_dev, t, portMAX_DELAY);
+        if (res != ESP_OK)
+        {
+            dev->shadow_valid = false;
+            return res;
+        }
+        dev->pending[idx]++;
+        dev->stats.transactions++;
+        dev->stats.bytes += dev->cascade_size * 2;
+    }
+    dev->back = !idx;
+    if (dirty_out)
+        *dirty_out = dirty;
+
+    return ESP_OK;
+}
+
+esp_err_t max7219_flush_wait(max7219_t *dev, TickType_t timeout)
+{
+    CHECK_ARG(dev);
+
+    while (dev->pending[0] || dev->pending[1])
+        CHECK(reap_one(dev, timeout));
+
+    return ESP_OK;
+}
+
+esp_err_t max7219_set_flush_callback(max7219_t *dev, max7219_flush_cb_t cb, void *arg)
+{
+    CHECK_ARG(dev);
+
+    dev->flush_cb = cb;
+    dev->flush_arg = arg;
+
+    return ESP_OK;
+}
+
+esp_err_t max7219_invalidate(max7219_t *dev)
+{
+    CHECK_ARG(dev);
+
+    dev->shadow_valid = false;
+
+    return ESP_OK;
+}
+
+esp_err_t max7219_get_stats(max7219_t *dev, max7219_stats_t *stats, bool reset)
+{
+    CHECK_ARG(dev && stats);
+
+    *stats = dev->stats;
+    if (reset)
+        memset(&dev->stats, 0, sizeof(dev->stats));
+
+    return ESP_OK;
+}
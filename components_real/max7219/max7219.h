@@ -56,11 +56,34 @@ extern "C" {
 
 #define MAX7219_MAX_CASCADE_SIZE 8
 #define MAX7219_MAX_BRIGHTNESS   15
+#define MAX7219_CHIP_DIGITS      8
+#define MAX7219_QUEUE_SIZE       (2 * MAX7219_CHIP_DIGITS) // two frames in flight
 
 /**
- * Display descriptor
+ * SPI traffic counters
  */
 typedef struct
+{
+    uint32_t transactions;       //!< SPI transactions sent
+    uint32_t bytes;              //!< Bytes sent
+    uint32_t transactions_saved; //!< Transactions skipped because no chip changed
+    uint32_t bytes_saved;        //!< Bytes skipped because no chip changed
+    uint32_t writes_saved;       //!< Per-chip digit writes replaced by no-op
+} max7219_stats_t;
+
+typedef struct max7219_s max7219_t;
+
+/**
+ * Async flush completion callback, called from the SPI ISR
+ * when the last transaction of a frame is done. A frame with no
+ * changed rows queues nothing and gets no callback.
+ */
+typedef void (*max7219_flush_cb_t)(max7219_t *dev, void *arg);
+
+/**
+ * Display descriptor
+ */
+struct max7219_s
 {
     spi_device_interface_config_t spi_cfg;
     spi_device_handle_t spi_dev;
@@ -68,7 +91,16 @@ typedef struct
     uint8_t cascade_size;        //!< Up to `MAX7219_MAX_CASCADE_SIZE` MAX721xx cascaded
     bool mirrored;               //!< true for horizontally mirrored displays
     bool bcd;
-} max7219_t;
+    uint8_t shadow[MAX7219_MAX_CASCADE_SIZE][MAX7219_CHIP_DIGITS]; //!< Last value written to each digit register
+    bool shadow_valid;           //!< false until the shadow matches the chips
+    max7219_stats_t stats;       //!< SPI traffic counters
+    max7219_flush_cb_t flush_cb; //!< Async flush completion callback, nullable
+    void *flush_arg;             //!< Argument for `flush_cb`
+    uint16_t txbuf[2][MAX7219_CHIP_DIGITS][MAX7219_MAX_CASCADE_SIZE]; //!< Async frame buffers
+    spi_transaction_t trans[2][MAX7219_CHIP_DIGITS]; //!< Async transactions
+    uint8_t pending[2];          //!< Queued transactions per frame buffer
+    uint8_t back;                //!< Frame buffer for the next async draw
+};
 
 /**
  * @brief Initialize device descriptor
@@ -165,6 +197,75 @@ esp_err_t max7219_draw_text_7seg(max7219_t *dev, uint8_t pos, const char *s);
  */
 esp_err_t max7219_draw_image_8x8(max7219_t *dev, uint8_t pos, const void *image);
 
+/**
+ * @brief Draw a whole frame on the cascade
+ *
+ * Sends the frame as up to 8 SPI transactions, one per digit register,
+ * each carrying data for every chip in the cascade. Chips whose register
+ * already holds the value get a no-op word, and rows where nothing
+ * changed are not sent at all.
+ *
+ * @param dev Display descriptor
+ * @param fb Frame buffer, one byte per digit, `dev->digits` bytes
+ * @return `ESP_OK` on success
+ */
+esp_err_t max7219_draw_framebuffer(max7219_t *dev, const uint8_t *fb);
+
+/**
+ * @brief Draw a whole frame on the cascade without waiting for the bus
+ *
+ * Same as max7219_draw_framebuffer(), but the rows are queued for DMA
+ * and the function returns as soon as they are queued. Frames are
+ * double buffered: the call only blocks if the frame before the
+ * previous one is still in flight. `fb` may be reused on return.
+ *
+ * @param dev Display descriptor
+ * @param fb Frame buffer, one byte per digit, `dev->digits` bytes
+ * @param[out] dirty Rows queued, bit per digit register, nullable;
+ *                   0 means nothing was queued and no flush callback follows
+ * @return `ESP_OK` on success
+ */
+esp_err_t max7219_draw_framebuffer_async(max7219_t *dev, const uint8_t *fb, uint8_t *dirty);
+
+/**
+ * @brief Wait until all queued frames are on the bus
+ *
+ * @param dev Display descriptor
+ * @param timeout Max time to wait for each transaction
+ * @return `ESP_OK` on success
+ */
+esp_err_t max7219_flush_wait(max7219_t *dev, TickType_t timeout);
+
+/**
+ * @brief Set async flush completion callback
+ *
+ * @param dev Display descriptor
+ * @param cb Callback, usually called from ISR context; NULL to disable
+ * @param arg Callback argument
+ * @return `ESP_OK` on success
+ */
+esp_err_t max7219_set_flush_callback(max7219_t *dev, max7219_flush_cb_t cb, void *arg);
+
+/**
+ * @brief Forget the shadow registers
+ *
+ * The next framebuffer draw rewrites every digit register.
+ *
+ * @param dev Display descriptor
+ * @return `ESP_OK` on success
+ */
+esp_err_t max7219_invalidate(max7219_t *dev);
+
+/**
+ * @brief Get SPI traffic counters
+ *
+ * @param dev Display descriptor
+ * @param[out] stats Counters
+ * @param reset Zero the counters after reading
+ * @return `ESP_OK` on success
+ */
+esp_err_t max7219_get_stats(max7219_t *dev, max7219_stats_t *stats, bool reset);
+
 #ifdef __cplusplus
 }
 #endif
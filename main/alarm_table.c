@@ -0,0 +1,234 @@
+#include <string.h>
+#include <time.h>
+#include "alarm_table.h"
+
+static int64_t tm_to_us(struct tm *t)
+{
+    t->tm_isdst = -1;
+    return (int64_t)mktime(t) * 1000000LL;
+}
+
+int64_t alarm_next_fire_us(const alarm_entry_t *e, int64_t now_us)
+{
+    int64_t cand = -1;
+    time_t now = (time_t)(now_us / 1000000LL);
+    struct tm base;
+    localtime_r(&now, &base);
+
+    if (!e->enabled) {
+        // only a pending snooze keeps a fired one-shot alive
+    } else if (e->wday_mask == 0 && e->year) {
+        struct tm f = {0};
+        f.tm_year = e->year - 1900; f.tm_mon = e->mon - 1; f.tm_mday = e->mday;
+        f.tm_hour = e->hour; f.tm_min = e->min;
+        int64_t us = tm_to_us(&f);
+        if (us > now_us) cand = us;
+    } else {
+        // today .. a week ahead; mktime normalises the day and fills tm_wday
+        for (int d = 0; d <= 7; ++d) {
+            struct tm f = base;
+            f.tm_mday += d; f.tm_hour = e->hour; f.tm_min = e->min; f.tm_sec = 0;
+            int64_t us = tm_to_us(&f);
+            if (us <= now_us) continue;
+            if (e->wday_mask && !(e->wday_mask & (1 << f.tm_wday))) continue;
+            cand = us;
+            break;
+        }
+    }
+
+    if (e->snooze_us > now_us && (cand < 0 || e->snooze_us < cand)) cand = e->snooze_us;
+    return cand;
+}
+
+static inline bool earlier(const alarm_table_t *t, int a, int b)
+{
+    return t->e[t->heap[a]].next_us < t->e[t->heap[b]].next_us;
+}
+
+static void heap_swap(alarm_table_t *t, int a, int b)
+{
+    uint8_t s = t->heap[a];
+    t->heap[a] = t->heap[b];
+    t->heap[b] = s;
+    t->pos[t->heap[a]] = (int8_t)a;
+    t->pos[t->heap[b]] = (int8_t)b;
+}
+
+static void sift_up(alarm_table_t *t, int i)
+{
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (!earlier(t, i, p)) break;
+        heap_swap(t, i, p);
+        i = p;
+    }
+}
+
+static void sift_down(alarm_table_t *t, int i)
+{
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < t->heap_len && earlier(t, l, m)) m = l;
+        if (r < t->heap_len && earlier(t, r, m)) m = r;
+        if (m == i) break;
+        heap_swap(t, i, m);
+        i = m;
+    }
+}
+
+static void heap_remove(alarm_table_t *t, int slot)
+{
+    int i = t->pos[slot];
+    if (i < 0) return;
+    int last = --t->heap_len;
+    if (i != last) {
+        heap_swap(t, i, last);
+        sift_down(t, i);
+        sift_up(t, i);
+    }
+    t->pos[slot] = -1;
+}
+
+/* (Re)queue a slot after its next_us changed. */
+static void heap_fix(alarm_table_t *t, int slot)
+{
+    if (t->e[slot].next_us < 0) {
+        heap_remove(t, slot);
+        return;
+    }
+    int i = t->pos[slot];
+    if (i < 0) {
+        i = t->heap_len++;
+        t->heap[i] = (uint8_t)slot;
+        t->pos[slot] = (int8_t)i;
+    }
+    sift_up(t, i);
+    sift_down(t, t->pos[slot]);
+}
+
+static int find_slot(const alarm_table_t *t, uint8_t id)
+{
+    if (!id) return -1;
+    for (int i = 0; i < ALARM_TABLE_MAX; ++i)
+        if (t->e[i].id == id) return i;
+    return -1;
+}
+
+void alarm_table_init(alarm_table_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    memset(t->pos, -1, sizeof(t->pos));
+    t->next_id = ALARM_ID_PRIMARY + 1;
+}
+
+int alarm_table_add(alarm_table_t *t, const alarm_entry_t *src, int64_t now_us)
+{
+    uint8_t id = src->id;
+    if (id) {
+        if (find_slot(t, id) >= 0) return -1;
+    } else {
+        // ids wrap past 255; skip 0, the primary and ids still in use
+        for (int tries = 0; tries < 256; ++tries) {
+            id = t->next_id++;
+            if (t->next_id <= ALARM_ID_PRIMARY) t->next_id = ALARM_ID_PRIMARY + 1;
+            if (id > ALARM_ID_PRIMARY && find_slot(t, id) < 0) break;
+            id = 0;
+        }
+        if (!id) return -1;
+    }
+
+    int slot;
+    for (slot = 0; slot < ALARM_TABLE_MAX && t->e[slot].id; ++slot) {}
+    if (slot >= ALARM_TABLE_MAX) return -1;
+
+    t->e[slot] = *src;
+    t->e[slot].id = id;
+    t->e[slot].next_us = alarm_next_fire_us(&t->e[slot], now_us);
+    heap_fix(t, slot);
+    return id;
+}
+
+bool alarm_table_update(alarm_table_t *t, uint8_t id, const alarm_entry_t *src, int64_t now_us)
+{
+    int slot = find_slot(t, id);
+    if (slot < 0) return false;
+    t->e[slot] = *src;
+    t->e[slot].id = id;
+    t->e[slot].next_us = alarm_next_fire_us(&t->e[slot], now_us);
+    heap_fix(t, slot);
+    return true;
+}
+
+bool alarm_table_delete(alarm_table_t *t, uint8_t id)
+{
+    int slot = find_slot(t, id);
+    if (slot < 0) return false;
+    heap_remove(t, slot);
+    memset(&t->e[slot], 0, sizeof(t->e[slot]));
+    return true;
+}
+
+bool alarm_table_snooze(alarm_table_t *t, uint8_t id, int64_t until_us)
+{
+    int slot = find_slot(t, id);
+    if (slot < 0) return false;
+    alarm_entry_t *e = &t->e[slot];
+    e->snooze_us = until_us;
+    if (e->next_us < 0 || until_us < e->next_us) {
+        e->next_us = until_us;
+        heap_fix(t, slot);
+    }
+    return true;
+}
+
+const alarm_entry_t *alarm_table_find(const alarm_table_t *t, uint8_t id)
+{
+    int slot = find_slot(t, id);
+    return slot < 0 ? NULL : &t->e[slot];
+}
+
+const alarm_entry_t *alarm_table_peek(const alarm_table_t *t)
+{
+    return t->heap_len ? &t->e[t->heap[0]] : NULL;
+}
+
+int alarm_table_pop_due(alarm_table_t *t, int64_t now_us, int64_t grace_us, uint8_t *ids, int max)
+{
+    int n = 0;
+    while (t->heap_len) {
+        int slot = t->heap[0];
+        alarm_entry_t *e = &t->e[slot];
+        if (e->next_us > now_us) break;
+
+        if (now_us - e->next_us < grace_us && n < max) ids[n++] = e->id;
+
+        bool snoozed = e->snooze_us && e->snooze_us <= now_us;
+        e->snooze_us = 0;
+        if (e->wday_mask == 0 && !snoozed) e->enabled = false;
+        e->next_us = alarm_next_fire_us(e, now_us);
+        heap_fix(t, slot);
+    }
+    return n;
+}
+
+void alarm_table_rebuild(alarm_table_t *t, int64_t now_us)
+{
+    t->heap_len = 0;
+    for (int i = 0; i < ALARM_TABLE_MAX; ++i) {
+        t->pos[i] = -1;
+        if (!t->e[i].id) continue;
+        t->e[i].next_us = alarm_next_fire_us(&t->e[i], now_us);
+        if (t->e[i].next_us < 0) continue;
+        t->pos[i] = (int8_t)t->heap_len;
+        t->heap[t->heap_len++] = (uint8_t)i;
+    }
+    for (int i = t->heap_len / 2 - 1; i >= 0; --i) sift_down(t, i);
+}
+
+int alarm_table_list(const alarm_table_t *t, alarm_entry_t *out, int max)
+{
+    int n = 0;
+    for (int i = 0; i < ALARM_TABLE_MAX && n < max; ++i)
+        if (t->e[i].id) out[n++] = t->e[i];
+    return n;
+}
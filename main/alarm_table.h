@@ -0,0 +1,63 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Alarm table ordered by next fire time in a binary min-heap:
+ * peek is O(1), add/update/delete/fire are O(log n).
+ * Plain C on top of <time.h>; callers provide locking. */
+
+#define ALARM_TABLE_MAX   32
+#define ALARM_ID_PRIMARY  1      // the legacy single alarm (BLE 0xFFF1)
+#define ALARM_WDAY_ALL    0x7F   // bit0 = Sunday .. bit6 = Saturday
+
+typedef struct {
+    uint8_t  id;          // 1..255, 0 = free slot
+    uint8_t  hour, min;
+    uint8_t  wday_mask;   // 0 = one-shot
+    uint16_t year;        // one-shot date; 0 = next hh:mm
+    uint8_t  mon, mday;   // 1-based
+    bool     enabled;
+    int64_t  snooze_us;   // epoch us, 0 = not snoozed
+    int64_t  next_us;     // epoch us, -1 = not scheduled
+} alarm_entry_t;
+
+typedef struct {
+    alarm_entry_t e[ALARM_TABLE_MAX];
+    uint8_t heap[ALARM_TABLE_MAX];   // slot indices, ordered by next_us
+    int8_t  pos[ALARM_TABLE_MAX];    // heap index of each slot, -1 = not queued
+    uint8_t heap_len;
+    uint8_t next_id;
+} alarm_table_t;
+
+void alarm_table_init(alarm_table_t *t);
+
+// src->id may name a free id (e.g. ALARM_ID_PRIMARY); 0 allocates one. Returns id or -1.
+int  alarm_table_add(alarm_table_t *t, const alarm_entry_t *src, int64_t now_us);
+bool alarm_table_update(alarm_table_t *t, uint8_t id, const alarm_entry_t *src, int64_t now_us);
+bool alarm_table_delete(alarm_table_t *t, uint8_t id);
+bool alarm_table_snooze(alarm_table_t *t, uint8_t id, int64_t until_us);
+const alarm_entry_t *alarm_table_find(const alarm_table_t *t, uint8_t id);
+
+// earliest scheduled entry, NULL if none
+const alarm_entry_t *alarm_table_peek(const alarm_table_t *t);
+
+/* Advance every entry due at now_us (next_us <= now_us). Ids of those
+ * less than grace_us late are written to ids (up to max); the count is
+ * returned. Recurring entries move to their next day, one-shots disable. */
+int  alarm_table_pop_due(alarm_table_t *t, int64_t now_us, int64_t grace_us, uint8_t *ids, int max);
+
+// recompute every entry from now_us after a clock change, O(n)
+void alarm_table_rebuild(alarm_table_t *t, int64_t now_us);
+
+int  alarm_table_list(const alarm_table_t *t, alarm_entry_t *out, int max);
+
+// next fire instant strictly after now_us, -1 if none
+int64_t alarm_next_fire_us(const alarm_entry_t *e, int64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,132 +1,219 @@
 #include "alarm_task.h"
 #include "app_state.h"
 #include "time_svc.h"
-#include "buzzer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_timer.h"
-#include "led.h"
+#include "pattern.h"
+#include "tone.h"
 #include "ble_alarm.h"
+#include "nvs.h"
 
 static const char *TAGA = "alarm_task";
 
-static const int s_sos_durations_ms[] = {
-    200,200, 200,200, 200,600,
-    600,200, 600,200, 600,600,
-    200,200, 200,200, 200,1000
-};
-static const bool s_sos_on_step[] = {
-    true,false, true,false, true,false,
-    true,false, true,false, true,false,
-    true,false, true,false, true,false
-};
-static const int s_sos_steps = sizeof(s_sos_durations_ms)/sizeof(s_sos_durations_ms[0]);
-static int s_sos_idx = 0;
-static int64_t s_sos_next_us = 0;
-
 typedef enum {
     ALARM_CMD_CLICK_BEEP = 0,
     ALARM_CMD_CONFIRM_BEEP,
-    ALARM_CMD_STOP_RING
+    ALARM_CMD_STOP_RING,
+    ALARM_CMD_START_RING,
+    ALARM_CMD_RESCHEDULE,
+    ALARM_CMD_CLOCK_CHANGED,
+    ALARM_CMD_SNOOZE,
+    ALARM_CMD_FIRE
 } alarm_cmd_t;
 
 static QueueHandle_t s_alarm_q = NULL;
 
-static bool s_click_active = false;
-static int64_t s_click_until_us = 0;
+// A forward clock jump may skip the fire instant; still ring if it is this recent
+#define ALARM_LATE_GRACE_US (5LL * 60 * 1000000)
+
+#define ALARM_NVS_NAMESPACE "alarm"
+#define ALARM_NVS_KEY       "table"
+
+static esp_timer_handle_t s_fire_timer = NULL;
+
+static alarm_table_t s_table;
+static SemaphoreHandle_t s_table_mtx = NULL;
+static bool s_table_anchored = false;  // next_us computed on a valid clock
+static uint8_t s_ringing_id = 0;       // alarm that is ringing, 0 = countdown/none
 
-static bool s_confirm_active = false;
-static int64_t s_confirm_until_us = 0;
 
-static inline int64_t now_us(void) { return esp_timer_get_time(); }
+static void fire_timer_cb(void *arg)
+{
+    alarm_cmd_t c = ALARM_CMD_FIRE;
+    (void)xQueueSend(s_alarm_q, &c, 0);
+}
+
+static void start_ring(uint8_t alarm_id)
+{
+    if (s_alarm_ringing) return;
+    s_alarm_ringing = true;
+    s_ringing_id = alarm_id;
+    pattern_play(PATTERN_OUT_LED, &PATTERN_SOS, PATTERN_PRIO_RING);
+    tone_play(TONE_VOICE_RING, &TONE_RING);
+    if (alarm_id) ESP_LOGW(TAGA, "ALARM RING id=%u !", alarm_id);
+    else          ESP_LOGW(TAGA, "COUNTDOWN RING !");
+    ble_alarm_notify_ringing(1);
+}
+
+/* Caller holds s_table_mtx. */
+static void table_save_locked(void)
+{
+    static alarm_entry_t buf[ALARM_TABLE_MAX];
+    int n = alarm_table_list(&s_table, buf, ALARM_TABLE_MAX);
+
+    nvs_handle_t h;
+    if (nvs_open(ALARM_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return;
+    if (nvs_set_blob(h, ALARM_NVS_KEY, buf, n * sizeof(buf[0])) == ESP_OK) nvs_commit(h);
+    nvs_close(h);
+}
 
-static void buzzer_arbitrate_output(void)
+/* Mirror the table into the legacy single-alarm state. Caller holds s_table_mtx. */
+static void mirror_legacy_locked(void)
 {
-    if (s_alarm_ringing || s_confirm_active || s_click_active) {
-        buzzer_on();
+    bool any = false;
+    for (int i = 0; i < ALARM_TABLE_MAX; ++i)
+        if (s_table.e[i].id && s_table.e[i].enabled) { any = true; break; }
+    s_alarm_enabled = any;
+
+    const alarm_entry_t *p = alarm_table_find(&s_table, ALARM_ID_PRIMARY);
+    if (p && s_mode != MODE_ALARM_SET) { s_alarm_hour = p->hour; s_alarm_min = p->min; }
+}
+
+/* Caller holds s_table_mtx. */
+static void table_changed_locked(void)
+{
+    mirror_legacy_locked();
+    // entries computed on an unset clock are recomputed once it is valid
+    if (!time_svc_is_valid()) s_table_anchored = false;
+    table_save_locked();
+    ble_alarm_adv_refresh();
+}
+
+static void table_load(void)
+{
+    static alarm_entry_t buf[ALARM_TABLE_MAX];
+    size_t len = sizeof(buf);
+    int64_t wall_us = time_svc_now_ms() * 1000LL;
+
+    alarm_table_init(&s_table);
+    nvs_handle_t h;
+    if (nvs_open(ALARM_NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        if (nvs_get_blob(h, ALARM_NVS_KEY, buf, &len) == ESP_OK) {
+            for (size_t i = 0; i < len / sizeof(buf[0]); ++i)
+                alarm_table_add(&s_table, &buf[i], wall_us);
+        }
+        nvs_close(h);
+    }
+    s_table_anchored = time_svc_is_valid();
+    mirror_legacy_locked();
+    ESP_LOGI(TAGA, "Loaded %u alarm(s)", (unsigned)(len / sizeof(buf[0])));
+}
+
+/* Ring whatever is due, then arm the one-shot timer for the earliest
+ * entry. Entries the clock has just jumped over (within the grace) still
+ * ring; after a clock change every entry is recomputed. */
+static void alarm_schedule(bool clock_changed)
+{
+    int64_t wall_us = time_svc_now_ms() * 1000LL;
+    esp_timer_stop(s_fire_timer);
+    if (!time_svc_is_valid()) return;
+
+    uint8_t due[4];
+    int n = 0;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    if (!s_table_anchored) {
+        alarm_table_rebuild(&s_table, wall_us);
+        s_table_anchored = true;
     } else {
-        buzzer_off();
+        n = alarm_table_pop_due(&s_table, wall_us, ALARM_LATE_GRACE_US, due, 4);
+        if (clock_changed) alarm_table_rebuild(&s_table, wall_us);
+        if (n) table_changed_locked();
     }
+    const alarm_entry_t *top = alarm_table_peek(&s_table);
+    int64_t next_us = top ? top->next_us : -1;
+    uint8_t next_id = top ? top->id : 0;
+    xSemaphoreGive(s_table_mtx);
+
+    if (n) start_ring(due[0]);
+    if (next_us < 0) return;
+
+    // esp_timer and the drift-corrected clock may disagree by a few ms;
+    // an early fire finds nothing due and lands back here
+    esp_timer_start_once(s_fire_timer, (uint64_t)(next_us - wall_us));
+    ESP_LOGI(TAGA, "Alarm id=%u armed, fires in %lld s",
+             next_id, (long long)((next_us - wall_us) / 1000000));
+}
+
+static void stop_ring(void)
+{
+    s_alarm_ringing = false;
+    s_ringing_id = 0;
+    pattern_stop(PATTERN_OUT_LED, PATTERN_PRIO_RING);
+    tone_stop(TONE_VOICE_RING);
+    ble_alarm_notify_ringing(0);
 }
 
 static void alarm_mgr_task(void *arg)
 {
-    buzzer_init();
-    alarm_led_init();
-    s_alarm_q = xQueueCreate(8, sizeof(alarm_cmd_t));
+    pattern_init();
+    tone_init();
 
-    int last_checked_sec = -1;
+    const esp_timer_create_args_t targs = {
+        .callback = fire_timer_cb,
+        .name = "alarm_fire",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&targs, &s_fire_timer));
+    alarm_schedule(false);
 
+    // LED edges are timed by RMT and tones by esp_timer; this task only sleeps on commands
     while (1) {
         alarm_cmd_t cmd;
-        while (xQueueReceive(s_alarm_q, &cmd, 0) == pdTRUE) {
+        if (xQueueReceive(s_alarm_q, &cmd, portMAX_DELAY) == pdTRUE) {
             switch (cmd) {
+            // the LED echoes the beeps; a ringing SOS outranks both and keeps playing
             case ALARM_CMD_CLICK_BEEP:
-                if (!s_alarm_ringing && !s_confirm_active) {
-                    s_click_active = true;
-                    s_click_until_us = now_us() + 30000;
-                }
+                tone_play(TONE_VOICE_CLICK, &TONE_CLICK);
+                pattern_play(PATTERN_OUT_LED, &PATTERN_CLICK, PATTERN_PRIO_CLICK);
                 break;
             case ALARM_CMD_CONFIRM_BEEP:
-                s_click_active = false;
-                s_confirm_active = true;
-                s_confirm_until_us = now_us() + 1000000;
+                tone_play(TONE_VOICE_CONFIRM, &TONE_CONFIRM);
+                pattern_play(PATTERN_OUT_LED, &PATTERN_CONFIRM, PATTERN_PRIO_CONFIRM);
                 break;
             case ALARM_CMD_STOP_RING:
-                s_alarm_ringing = false;
-                s_sos_idx = 0;
-                s_sos_next_us = 0;
-                ble_alarm_notify_ringing(0);  
+                stop_ring();
+                break;
+            case ALARM_CMD_START_RING:
+                start_ring(0);
+                break;
+            case ALARM_CMD_RESCHEDULE:
+            case ALARM_CMD_FIRE:
+                alarm_schedule(false);
+                break;
+            case ALARM_CMD_CLOCK_CHANGED:
+                alarm_schedule(true);
+                break;
+            case ALARM_CMD_SNOOZE:
+                if (s_alarm_ringing && s_ringing_id) {
+                    ESP_LOGI(TAGA, "Snooze id=%u for %d min", s_ringing_id, ALARM_SNOOZE_MIN);
+                    alarm_snooze(s_ringing_id, ALARM_SNOOZE_MIN);
+                    stop_ring();
+                }
                 break;
             }
         }
-
-        struct tm tmv;
-        time_svc_get_localtime(&tmv);
-
-        if (tmv.tm_sec != last_checked_sec) {
-            last_checked_sec = tmv.tm_sec;
-
-            if (s_alarm_enabled && !s_alarm_ringing &&
-                tmv.tm_hour == s_alarm_hour &&
-                tmv.tm_min  == s_alarm_min &&
-                tmv.tm_sec  == 0)
-            {
-                s_alarm_ringing = true;
-                ESP_LOGW(TAGA, "ALARM RING %02d:%02d !", s_alarm_hour, s_alarm_min);
-                ble_alarm_notify_ringing(1); 
-            }
-        }
-        int64_t t = now_us();
-        if (s_click_active && t >= s_click_until_us) s_click_active = false;
-        if (s_confirm_active && t >= s_confirm_until_us) s_confirm_active = false;
-
-        buzzer_arbitrate_output();
-        if (s_alarm_ringing) {
-            int64_t tnow = now_us();
-            if (tnow >= s_sos_next_us) {
-                if (s_sos_on_step[s_sos_idx]) alarm_led_on();
-                else                           alarm_led_off();
-
-                int dur_ms = s_sos_durations_ms[s_sos_idx];
-                s_sos_next_us = tnow + (int64_t)dur_ms * 1000LL;
-                s_sos_idx = (s_sos_idx + 1) % s_sos_steps;
-            }
-        } else {
-            alarm_led_off();
-            s_sos_idx = 0;
-            s_sos_next_us = 0;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
 void alarm_start_task(void)
 {
-    xTaskCreate(alarm_mgr_task, "alarm_task", 3072, NULL, 6, NULL);
+    s_table_mtx = xSemaphoreCreateMutex();
+    table_load();
+    s_alarm_q = xQueueCreate(8, sizeof(alarm_cmd_t));
+    xTaskCreate(alarm_mgr_task, "alarm_task", 4096, NULL, 6, NULL);
 }
 
 void alarm_send_click_beep(void)
@@ -152,3 +239,123 @@ void alarm_send_stop_ring(void)
         (void)xQueueSend(s_alarm_q, &c, 0);
     }
 }
+
+void alarm_send_start_ring(void)
+{
+    if (s_alarm_q) {
+        alarm_cmd_t c = ALARM_CMD_START_RING;
+        (void)xQueueSend(s_alarm_q, &c, 0);
+    }
+}
+
+void alarm_reschedule(void)
+{
+    if (s_alarm_q) {
+        alarm_cmd_t c = ALARM_CMD_RESCHEDULE;
+        (void)xQueueSend(s_alarm_q, &c, 0);
+    }
+}
+
+void alarm_notify_clock_change(void)
+{
+    if (s_alarm_q) {
+        alarm_cmd_t c = ALARM_CMD_CLOCK_CHANGED;
+        (void)xQueueSend(s_alarm_q, &c, 0);
+    }
+}
+
+void alarm_send_snooze(void)
+{
+    if (s_alarm_q) {
+        alarm_cmd_t c = ALARM_CMD_SNOOZE;
+        (void)xQueueSend(s_alarm_q, &c, 0);
+    }
+}
+
+static bool entry_valid(const alarm_entry_t *e)
+{
+    if (e->hour > 23 || e->min > 59 || (e->wday_mask & ~ALARM_WDAY_ALL)) return false;
+    if (e->wday_mask == 0 && e->year &&
+        (e->mon < 1 || e->mon > 12 || e->mday < 1 || e->mday > 31)) return false;
+    return true;
+}
+
+int alarm_add(const alarm_entry_t *e)
+{
+    if (!s_table_mtx || !entry_valid(e)) return -1;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    int id = alarm_table_add(&s_table, e, time_svc_now_ms() * 1000LL);
+    if (id > 0) table_changed_locked();
+    xSemaphoreGive(s_table_mtx);
+    if (id > 0) alarm_reschedule();
+    return id;
+}
+
+bool alarm_update(uint8_t id, const alarm_entry_t *e)
+{
+    if (!s_table_mtx || !entry_valid(e)) return false;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    bool ok = alarm_table_update(&s_table, id, e, time_svc_now_ms() * 1000LL);
+    if (ok) table_changed_locked();
+    xSemaphoreGive(s_table_mtx);
+    if (ok) alarm_reschedule();
+    return ok;
+}
+
+bool alarm_delete(uint8_t id)
+{
+    if (!s_table_mtx) return false;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    bool ok = alarm_table_delete(&s_table, id);
+    if (ok) table_changed_locked();
+    xSemaphoreGive(s_table_mtx);
+    if (ok) alarm_reschedule();
+    return ok;
+}
+
+bool alarm_snooze(uint8_t id, int minutes)
+{
+    if (!s_table_mtx || minutes <= 0) return false;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    bool ok = alarm_table_snooze(&s_table, id,
+                                 time_svc_now_ms() * 1000LL + (int64_t)minutes * 60 * 1000000LL);
+    if (ok) table_changed_locked();
+    xSemaphoreGive(s_table_mtx);
+    if (ok) alarm_reschedule();
+    return ok;
+}
+
+bool alarm_get(uint8_t id, alarm_entry_t *out)
+{
+    if (!s_table_mtx) return false;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    const alarm_entry_t *p = alarm_table_find(&s_table, id);
+    if (p) *out = *p;
+    xSemaphoreGive(s_table_mtx);
+    return p != NULL;
+}
+
+int alarm_list(alarm_entry_t *out, int max)
+{
+    if (!s_table_mtx) return 0;
+    xSemaphoreTake(s_table_mtx, portMAX_DELAY);
+    int n = alarm_table_list(&s_table, out, max);
+    xSemaphoreGive(s_table_mtx);
+    return n;
+}
+
+bool alarm_set_primary(int hour, int min, bool enabled)
+{
+    alarm_entry_t e = {0};
+    e.id = ALARM_ID_PRIMARY;
+    e.hour = (uint8_t)hour; e.min = (uint8_t)min;
+    e.wday_mask = ALARM_WDAY_ALL;
+    e.enabled = enabled;
+    if (alarm_get(ALARM_ID_PRIMARY, &e)) {
+        e.hour = (uint8_t)hour; e.min = (uint8_t)min;
+        e.enabled = enabled;
+        e.snooze_us = 0;
+        return alarm_update(ALARM_ID_PRIMARY, &e);
+    }
+    return alarm_add(&e) > 0;
+}
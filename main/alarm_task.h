@@ -1,5 +1,7 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
+#include "alarm_table.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,6 +15,31 @@ void alarm_send_click_beep(void);
 void alarm_send_confirm_beep(void);
 
 void alarm_send_stop_ring(void);
+
+void alarm_send_start_ring(void);
+
+// re-arm the alarm timer after an alarm edit
+void alarm_reschedule(void);
+
+// recompute every alarm after the wall clock moved
+void alarm_notify_clock_change(void);
+
+// snooze the ringing alarm for ALARM_SNOOZE_MIN minutes
+void alarm_send_snooze(void);
+
+/* Alarm table, safe from any task. Mutations persist to NVS and
+ * re-arm the fire timer. */
+#define ALARM_SNOOZE_MIN 5
+
+int  alarm_add(const alarm_entry_t *e);                 // returns id or -1
+bool alarm_update(uint8_t id, const alarm_entry_t *e);
+bool alarm_delete(uint8_t id);
+bool alarm_snooze(uint8_t id, int minutes);
+bool alarm_get(uint8_t id, alarm_entry_t *out);
+int  alarm_list(alarm_entry_t *out, int max);          // ordered by slot
+
+// the legacy single alarm (BLE 0xFFF1/0xFFF3), a daily entry with ALARM_ID_PRIMARY
+bool alarm_set_primary(int hour, int min, bool enabled);
 void alarm_cmd_stop(void);
 #ifdef __cplusplus
 }
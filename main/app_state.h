@@ -9,6 +9,7 @@
 
 #include "driver/gpio.h"
 #include "max7219.h"
+#include "ui_fsm.h"
 
 
 #define WIFI_SSID "LORION"
@@ -19,7 +20,6 @@
 #define BUTTON2_GPIO   GPIO_NUM_10   
 #define BUTTON3_GPIO   GPIO_NUM_8     
 #define BUTTON4_GPIO   GPIO_NUM_2     
-#define DEBOUNCE_MS    250
 #define ALARM_LED_GPIO        GPIO_NUM_4
 #define ALARM_LED_ACTIVE_LEVEL 1
 
@@ -31,58 +31,34 @@
 
 #define SENSOR_TYPE  DHT_TYPE_DHT11
 #define DHT_GPIO_PIN GPIO_NUM_3
+// GPIO0 is the only pin left on the C3: 20/21 are the UART0 console, 18/19 USB-Serial-JTAG
+// #define DHT2_GPIO_PIN GPIO_NUM_0       // second (outdoor) probe, same type
+// optional I2C sensors, read next to the DHT; define the pins to enable the bus.
+// There is no free pair: SDA takes GPIO0 (so no DHT2), SCL takes U0RXD, which costs
+// console input only (nothing reads it; logs stay on GPIO21) - flash over USB then.
+// #define SENSOR_I2C_SDA     GPIO_NUM_0
+// #define SENSOR_I2C_SCL     GPIO_NUM_20
+// #define SENSOR_SHT3X_ADDR  0x44
+// #define SENSOR_BME280_ADDR 0x76
 
 
 #define BUZZER_GPIO            GPIO_NUM_1
 #define BUZZER_ACTIVE_LEVEL    1  
 
 
-typedef enum {
-    MODE_TIME = 0,     
-    MODE_WDAY,         
-    MODE_DDMM,         
-    MODE_YYYY,         
-    MODE_DHT,          
-    MODE_SW,           
-    MODE_ALARM_SET,    
-    MODE_COUNTDOWN_SET,
-    MODE_COUNTDOWN_RUN 
-} display_mode_t;
-
-
-typedef enum {
-    SW_RESET_SHOWN = 0, 
-    SW_RUNNING,        
-    SW_PAUSED           
-} sw_state_t;
-
-typedef enum {
-    ALARM_SEL_HOUR = 0,
-    ALARM_SEL_MIN
-} alarm_sel_t;
-
-
-typedef enum {
-    CD_SEL_MIN = 0,
-    CD_SEL_SEC
-} countdown_sel_t;
-
 extern volatile display_mode_t s_mode;
 
 extern max7219_t g_dev;
 
 extern struct tm g_tm;
-extern SemaphoreHandle_t g_time_mutex;
+extern volatile uint32_t g_tm_seq;   // odd while time_task is writing g_tm
 
-extern float s_temperature;
-extern float s_humidity;
 
 extern EventGroupHandle_t s_wifi_event_group;
 #define WIFI_CONNECTED_BIT BIT0
 
 
 extern volatile sw_state_t s_sw_state;
-extern volatile int  s_sw_mm, s_sw_ss;   
 extern volatile bool s_force_refresh;    
 
 
@@ -95,7 +71,7 @@ extern volatile bool        s_blink_on;
 
 extern volatile int  s_cd_min, s_cd_sec;      
 extern volatile countdown_sel_t s_cd_sel;     
-extern volatile bool s_cd_running;           
+extern volatile uint8_t s_cd_view_id;         // countdown shown in MODE_COUNTDOWN_RUN
 
 
 static inline void time_set_timezone_vn(void) {
@@ -2,6 +2,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 
 #include "esp_nimble_hci.h"
 #include "nimble/nimble_port.h"
@@ -13,28 +14,294 @@
 #include "app_state.h"     
 #include "alarm_task.h"    
 #include "ble_alarm.h"
+#include "display.h"
+#include "chrono.h"
+#include "latency.h"
+#include "history.h"
+#include "sensor_dht.h"
+#include "time_svc.h"
 
 static const char *TAG = "BLE_ALARM";
 
 #define BLE_SVC_UUID            0xFFF0
 #define BLE_CHR_ALARM_TIME_UUID 0xFFF1  // R/W: time
 #define BLE_CHR_RINGING_UUID    0xFFF2  // R/Notify: 0|1
-#define BLE_CHR_COMMAND_UUID    0xFFF3  // W: 0=STOP, 1=ENABLE, 2=DISABLE
+#define BLE_CHR_COMMAND_UUID    0xFFF3  // W: 0=STOP, 1=ENABLE, 2=DISABLE, 3=SNOOZE
+#define BLE_CHR_ALARM_LIST_UUID 0xFFF4  // R: records; W: op + args (see below)
+#define BLE_CHR_STOPWATCH_UUID  0xFFF5  // R: state, elapsed ms (u32 LE), lap count, laps (u32 LE ms, oldest first)
+#define BLE_CHR_TIMERS_UUID     0xFFF6  // R: per timer id, remaining ms, duration s (u32 LE)
+                                        // W: 01 seconds(u32 LE) = start, 02 id = cancel
+#define BLE_CHR_LATENCY_UUID    0xFFF7  // R: per stage (input, render, bus, total) count, p50, p95, max us (u32 LE)
+                                        // W: 00 = reset, 01 = log
+#define BLE_CHR_HISTORY_UUID    0xFFF8  // W: from, to (u32 LE epoch s)
+                                        // R: count, then per record t (u32 LE), temp, hum (i16 LE, 0.1)
+                                        // page by writing from = last t + 1
+#define BLE_CHR_SENSOR_RATE_UUID 0xFFF9 // R: period ms, reads, failures (u32 LE), failure streak (u16 LE)
+#define BLE_CHR_ADV_ITVL_UUID   0xFFFA  // R/W: advertising interval ms (u16 LE, 100..10240), kept in NVS
+#define HIST_PAGE_RECS  24
+
+/* Broadcast: the advertisement carries the clock's state as manufacturer
+ * data, so a scanner can watch many clocks without connecting. The name
+ * moves to the scan response to make room. Company id 0xFFFF is the SIG's
+ * id for tests and internal use. Payload, BCAST_LEN bytes:
+ *   version, seq (bumped on every change),
+ *   temp (i16 LE, 0.1 C), hum (i16 LE, 0.1 %RH), both BCAST_NO_VALUE until a read,
+ *   flags (BCAST_F_*), alarm hour, alarm min
+ * The modules that change a value call ble_alarm_adv_refresh(). While a
+ * client is connected the clock keeps broadcasting, non-connectable. */
+#define BCAST_COMPANY_ID   0xFFFF
+#define BCAST_VERSION      1
+#define BCAST_LEN          9
+#define BCAST_NO_VALUE     INT16_MIN
+#define BCAST_F_SENSOR     0x01   // temp/hum valid
+#define BCAST_F_ALARM_ON   0x02   // any alarm enabled
+#define BCAST_F_RINGING    0x04
+#define BCAST_F_TIME_VALID 0x08   // clock set
+#define BCAST_F_TIME_NTP   0x10   // clock confirmed by NTP
+
+#define ADV_ITVL_DEFAULT_MS 1000
+#define ADV_ITVL_MIN_MS     100   // non-connectable legacy advertising floor
+#define ADV_ITVL_MAX_MS     10240
+#define BLE_NVS_NAMESPACE   "ble"
+#define BLE_NVS_KEY_ITVL    "adv_ms"
+#define TIMER_OP_START  1
+#define TIMER_OP_CANCEL 2
+
+/* Alarm list record, ALARM_REC_LEN bytes:
+ *   id, hour, min, wday_mask (bit0=Sun, 0=one-shot), flags (bit0 enabled, bit1 snoozed),
+ *   year lo, year hi, mon, mday
+ * Writes:
+ *   01 <record without id>  add
+ *   02 <record>             update
+ *   03 id                   delete
+ *   04 id minutes           snooze */
+#define ALARM_REC_LEN   9
+#define ALARM_OP_ADD    1
+#define ALARM_OP_UPDATE 2
+#define ALARM_OP_DELETE 3
+#define ALARM_OP_SNOOZE 4
 
 static uint16_t s_conn_handle = 0;
 static uint16_t h_alarm_time;
 static uint16_t h_ringing;
 static uint16_t h_command;
+static uint16_t h_alarm_list;
+static uint16_t h_stopwatch;
+static uint16_t h_timers;
+static uint16_t h_latency;
+static uint16_t h_history;
+static uint16_t h_sensor_rate;
+static uint16_t h_adv_itvl;
+static uint32_t s_hist_from, s_hist_to = UINT32_MAX;
+
+static SemaphoreHandle_t s_adv_mtx;
+static bool s_synced = false;
+static uint16_t s_adv_itvl_ms = ADV_ITVL_DEFAULT_MS;
+static uint8_t s_bcast[BCAST_LEN];       // state currently advertised, seq excluded from the compare
+static uint8_t s_bcast_seq;
+static volatile bool s_adv_pending;     // a refresh found s_adv_mtx taken
+
+static int gap_event_cb(struct ble_gap_event *event, void *arg);
+static void adv_start(void);
 
 
 static int read_alarm_time(uint8_t *buf, uint16_t maxlen) {
     if (maxlen < 2) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-    buf[0] = (uint8_t)s_alarm_hour;
-    buf[1] = (uint8_t)s_alarm_min;
+    alarm_entry_t a;
+    if (alarm_get(ALARM_ID_PRIMARY, &a)) {
+        buf[0] = a.hour;
+        buf[1] = a.min;
+    } else {
+        buf[0] = (uint8_t)s_alarm_hour;
+        buf[1] = (uint8_t)s_alarm_min;
+    }
     return 2;
 }
 
+static void alarm_to_rec(const alarm_entry_t *a, uint8_t *r) {
+    r[0] = a->id; r[1] = a->hour; r[2] = a->min; r[3] = a->wday_mask;
+    r[4] = (a->enabled ? 1 : 0) | (a->snooze_us ? 2 : 0);
+    r[5] = (uint8_t)(a->year & 0xFF); r[6] = (uint8_t)(a->year >> 8);
+    r[7] = a->mon; r[8] = a->mday;
+}
+
+static void rec_to_alarm(const uint8_t *r, alarm_entry_t *a) {
+    memset(a, 0, sizeof(*a));
+    a->id = r[0]; a->hour = r[1]; a->min = r[2]; a->wday_mask = r[3];
+    a->enabled = (r[4] & 1) != 0;
+    a->year = (uint16_t)(r[5] | (r[6] << 8));
+    a->mon = r[7]; a->mday = r[8];
+}
+
+static int alarm_list_read(struct os_mbuf *om) {
+    static alarm_entry_t list[ALARM_TABLE_MAX];
+    int n = alarm_list(list, ALARM_TABLE_MAX);
+    for (int i = 0; i < n; ++i) {
+        uint8_t r[ALARM_REC_LEN];
+        alarm_to_rec(&list[i], r);
+        if (os_mbuf_append(om, r, sizeof(r)) != 0) return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    return 0;
+}
+
+static void put_u32le(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+
+static int latency_read(struct os_mbuf *om) {
+    uint8_t buf[16 * LAT_STAGE_COUNT];
+    for (int i = 0; i < LAT_STAGE_COUNT; ++i) {
+        lat_summary_t s;
+        lat_get((lat_stage_t)i, &s);
+        put_u32le(&buf[16 * i + 0],  s.count);
+        put_u32le(&buf[16 * i + 4],  s.p50_us);
+        put_u32le(&buf[16 * i + 8],  s.p95_us);
+        put_u32le(&buf[16 * i + 12], s.max_us);
+    }
+    return os_mbuf_append(om, buf, sizeof(buf)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int latency_write(struct os_mbuf *om) {
+    if (OS_MBUF_PKTLEN(om) != 1) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    uint8_t op; os_mbuf_copydata(om, 0, 1, &op);
+    if (op == 0)      lat_reset();
+    else if (op == 1) lat_log();
+    else              return BLE_ATT_ERR_UNLIKELY;
+    return 0;
+}
+
+// the same page on every call, so long (blob) reads stay consistent
+static int history_read(struct os_mbuf *om) {
+    hist_rec_t recs[HIST_PAGE_RECS];
+    int n = hist_read(s_hist_from, s_hist_to, recs, HIST_PAGE_RECS);
+    if (n < 0) n = 0;
+    uint8_t buf[1 + 8 * HIST_PAGE_RECS];
+    buf[0] = (uint8_t)n;
+    for (int i = 0; i < n; ++i) {
+        uint8_t *p = &buf[1 + 8 * i];
+        put_u32le(p, recs[i].t);
+        p[4] = (uint16_t)recs[i].temp_c10 & 0xFF; p[5] = (uint16_t)recs[i].temp_c10 >> 8;
+        p[6] = (uint16_t)recs[i].hum_c10 & 0xFF;  p[7] = (uint16_t)recs[i].hum_c10 >> 8;
+    }
+    return os_mbuf_append(om, buf, 1 + 8 * n) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int history_write(struct os_mbuf *om) {
+    if (OS_MBUF_PKTLEN(om) != 8) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    uint8_t b[8]; os_mbuf_copydata(om, 0, 8, b);
+    s_hist_from = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+    s_hist_to   = b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24);
+    return 0;
+}
+
+static int sensor_rate_read(struct os_mbuf *om) {
+    sp_rate_t r;
+    sensor_dht_get_rate(&r);
+    uint8_t buf[14];
+    put_u32le(&buf[0], r.period_ms);
+    put_u32le(&buf[4], r.reads);
+    put_u32le(&buf[8], r.failures);
+    buf[12] = r.fail_streak & 0xFF; buf[13] = r.fail_streak >> 8;
+    return os_mbuf_append(om, buf, sizeof(buf)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int adv_itvl_read(struct os_mbuf *om) {
+    uint8_t buf[2] = { s_adv_itvl_ms & 0xFF, s_adv_itvl_ms >> 8 };
+    return os_mbuf_append(om, buf, sizeof(buf)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int adv_itvl_write(struct os_mbuf *om) {
+    if (OS_MBUF_PKTLEN(om) != 2) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    uint8_t b[2]; os_mbuf_copydata(om, 0, 2, b);
+    return ble_alarm_set_adv_interval(b[0] | (b[1] << 8)) == ESP_OK ? 0 : BLE_ATT_ERR_UNLIKELY;
+}
+
+static int stopwatch_read(struct os_mbuf *om) {
+    uint32_t laps[SW_LAP_MAX];
+    int n = sw_get_laps(laps, SW_LAP_MAX);
+    uint8_t buf[6 + 4 * SW_LAP_MAX];
+    buf[0] = (uint8_t)s_sw_state;
+    put_u32le(&buf[1], (uint32_t)(sw_elapsed_us() / 1000));
+    buf[5] = (uint8_t)n;
+    for (int i = 0; i < n; ++i) put_u32le(&buf[6 + 4 * i], laps[i]);
+    return os_mbuf_append(om, buf, 6 + 4 * n) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int timers_read(struct os_mbuf *om) {
+    cd_info_t list[CD_MAX_TIMERS];
+    int n = cd_list(list, CD_MAX_TIMERS);
+    for (int i = 0; i < n; ++i) {
+        uint8_t r[9];
+        r[0] = list[i].id;
+        put_u32le(&r[1], (uint32_t)(list[i].remaining_us / 1000));
+        put_u32le(&r[5], list[i].duration_s);
+        if (os_mbuf_append(om, r, sizeof(r)) != 0) return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    return 0;
+}
+
+static int timers_write(struct os_mbuf *om) {
+    uint8_t buf[5];
+    uint16_t len = OS_MBUF_PKTLEN(om);
+    if (len < 2 || len > sizeof(buf)) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    os_mbuf_copydata(om, 0, len, buf);
+
+    if (buf[0] == TIMER_OP_START && len == 5) {
+        uint32_t s = buf[1] | (buf[2] << 8) | (buf[3] << 16) | ((uint32_t)buf[4] << 24);
+        int id = cd_start((int64_t)s * 1000000LL);
+        ESP_LOGI(TAG, "BLE start timer %lu s -> id=%d", (unsigned long)s, id);
+        if (id < 0) return BLE_ATT_ERR_INSUFFICIENT_RES;
+    } else if (buf[0] == TIMER_OP_CANCEL && len == 2) {
+        if (!cd_cancel(buf[1])) return BLE_ATT_ERR_UNLIKELY;
+    } else {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    display_request_refresh();
+    return 0;
+}
+
+static int alarm_list_write(struct os_mbuf *om) {
+    uint8_t buf[1 + ALARM_REC_LEN];
+    uint16_t len = OS_MBUF_PKTLEN(om);
+    if (len < 2 || len > sizeof(buf)) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    os_mbuf_copydata(om, 0, len, buf);
+
+    alarm_entry_t a;
+    bool ok = false;
+    switch (buf[0]) {
+    case ALARM_OP_ADD: {
+        if (len != ALARM_REC_LEN) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        uint8_t r[ALARM_REC_LEN] = {0};
+        memcpy(&r[1], &buf[1], ALARM_REC_LEN - 1);
+        rec_to_alarm(r, &a);
+        int id = alarm_add(&a);
+        ok = id > 0;
+        ESP_LOGI(TAG, "BLE add alarm %02u:%02u wday=0x%02x -> id=%d", a.hour, a.min, a.wday_mask, id);
+        break;
+    }
+    case ALARM_OP_UPDATE:
+        if (len != 1 + ALARM_REC_LEN) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        rec_to_alarm(&buf[1], &a);
+        ok = alarm_update(a.id, &a);
+        break;
+    case ALARM_OP_DELETE:
+        if (len != 2) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        ok = alarm_delete(buf[1]);
+        break;
+    case ALARM_OP_SNOOZE:
+        if (len != 3) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        ok = alarm_snooze(buf[1], buf[2]);
+        break;
+    default:
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (!ok) return BLE_ATT_ERR_UNLIKELY;
+    display_request_refresh();
+    return 0;
+}
+
 void ble_alarm_notify_ringing(uint8_t st) {
+    ble_alarm_adv_refresh();
     if (s_conn_handle == 0) return;
     struct os_mbuf *om = ble_hs_mbuf_from_flat(&st, 1);
     if (om) ble_gatts_notify_custom(s_conn_handle, h_ringing, om);
@@ -63,7 +330,10 @@ static int gatt_access_cb(uint16_t conn_handle, uint16_t attr_handle,
             int h = buf[0], m = buf[1];
             if (h < 0 || h > 23 || m < 0 || m > 59) return BLE_ATT_ERR_UNLIKELY;
 
-            s_alarm_hour = h; s_alarm_min = m;  
+            alarm_entry_t a;
+            bool en = alarm_get(ALARM_ID_PRIMARY, &a) && a.enabled;
+            if (!alarm_set_primary(h, m, en)) return BLE_ATT_ERR_UNLIKELY;
+            display_request_refresh();
             ESP_LOGI(TAG, "BLE set alarm -> %02d:%02d", h, m);
             return 0;
         }
@@ -82,16 +352,69 @@ static int gatt_access_cb(uint16_t conn_handle, uint16_t attr_handle,
             uint8_t cmd; os_mbuf_copydata(ctxt->om, 0, 1, &cmd);
             if (cmd == 0) {            
                 alarm_send_stop_ring(); 
-            } else if (cmd == 1) {    
-                s_alarm_enabled = true;
-            } else if (cmd == 2) {     
-                s_alarm_enabled = false;
+            } else if (cmd == 1 || cmd == 2) {
+                alarm_entry_t a;
+                int h = s_alarm_hour, m = s_alarm_min;
+                if (alarm_get(ALARM_ID_PRIMARY, &a)) { h = a.hour; m = a.min; }
+                alarm_set_primary(h, m, cmd == 1);
+            } else if (cmd == 3) {
+                alarm_send_snooze();
             } else {
                 return BLE_ATT_ERR_UNLIKELY;
             }
             return 0;
         }
         break;
+
+    case BLE_CHR_ALARM_LIST_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+            return alarm_list_read(ctxt->om);
+        } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            return alarm_list_write(ctxt->om);
+        }
+        break;
+
+    case BLE_CHR_STOPWATCH_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) return stopwatch_read(ctxt->om);
+        break;
+
+    case BLE_CHR_TIMERS_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+            return timers_read(ctxt->om);
+        } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            return timers_write(ctxt->om);
+        }
+        break;
+
+    case BLE_CHR_LATENCY_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+            return latency_read(ctxt->om);
+        } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            return latency_write(ctxt->om);
+        }
+        break;
+
+    case BLE_CHR_HISTORY_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+            return history_read(ctxt->om);
+        } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            return history_write(ctxt->om);
+        }
+        break;
+
+    case BLE_CHR_SENSOR_RATE_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+            return sensor_rate_read(ctxt->om);
+        }
+        break;
+
+    case BLE_CHR_ADV_ITVL_UUID:
+        if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+            return adv_itvl_read(ctxt->om);
+        } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            return adv_itvl_write(ctxt->om);
+        }
+        break;
     default:
         break;
     }
@@ -116,6 +439,34 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
               .access_cb = gatt_access_cb,
               .flags = BLE_GATT_CHR_F_WRITE,
               .val_handle = &h_command },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_ALARM_LIST_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &h_alarm_list },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_STOPWATCH_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ,
+              .val_handle = &h_stopwatch },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_TIMERS_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &h_timers },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_LATENCY_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &h_latency },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_HISTORY_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &h_history },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_SENSOR_RATE_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ,
+              .val_handle = &h_sensor_rate },
+            { .uuid = BLE_UUID16_DECLARE(BLE_CHR_ADV_ITVL_UUID),
+              .access_cb = gatt_access_cb,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &h_adv_itvl },
             { 0 }
         }
     },
@@ -132,38 +483,136 @@ static int gap_event_cb(struct ble_gap_event *event, void *arg) {
             ESP_LOGI(TAG, "BLE connected. conn=%u", s_conn_handle);
         } else {
             s_conn_handle = 0;
-            ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER,
-                &(struct ble_gap_adv_params){ .conn_mode = BLE_GAP_CONN_MODE_UND, .disc_mode = BLE_GAP_DISC_MODE_GEN },
-                gap_event_cb, NULL);
         }
+        adv_start();
         break;
     case BLE_GAP_EVENT_DISCONNECT:
         s_conn_handle = 0;
-        ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER,
-            &(struct ble_gap_adv_params){ .conn_mode = BLE_GAP_CONN_MODE_UND, .disc_mode = BLE_GAP_DISC_MODE_GEN },
-            gap_event_cb, NULL);
+        adv_start();
         break;
     default: break;
     }
     return 0;
 }
 
-static void ble_advertise(void) {
-    struct ble_hs_adv_fields fields = {0};
-    const char *name = ble_svc_gap_device_name();
-    fields.name = (uint8_t*)name;
-    fields.name_len = (uint8_t)strlen(name);
-    fields.name_is_complete = 1;
+// hundredths to the nearest tenth, halves away from zero
+static int16_t c100_to_c10(int32_t v) {
+    return (int16_t)((v + (v < 0 ? -5 : 5)) / 10);
+}
+
+static void bcast_pack(uint8_t *p) {
+    sp_stats_t st, sh;
+    bool have = sensor_dht_get(&st, &sh);
+    int16_t t = have ? c100_to_c10(st.last) : BCAST_NO_VALUE;
+    int16_t h = have ? c100_to_c10(sh.last) : BCAST_NO_VALUE;
+    p[0] = BCAST_VERSION;
+    p[1] = 0;
+    p[2] = (uint16_t)t & 0xFF; p[3] = (uint16_t)t >> 8;
+    p[4] = (uint16_t)h & 0xFF; p[5] = (uint16_t)h >> 8;
+    p[6] = (have ? BCAST_F_SENSOR : 0)
+         | (s_alarm_enabled ? BCAST_F_ALARM_ON : 0)
+         | (s_alarm_ringing ? BCAST_F_RINGING : 0)
+         | (time_svc_is_valid() ? BCAST_F_TIME_VALID : 0)
+         | (time_svc_is_verified() ? BCAST_F_TIME_NTP : 0);
+    p[7] = (uint8_t)s_alarm_hour;
+    p[8] = (uint8_t)s_alarm_min;
+}
+
+// caller holds s_adv_mtx
+static int adv_set_data(void) {
+    uint8_t mfg[2 + BCAST_LEN];
+    mfg[0] = BCAST_COMPANY_ID & 0xFF; mfg[1] = BCAST_COMPANY_ID >> 8;
+    memcpy(&mfg[2], s_bcast, BCAST_LEN);
+    mfg[3] = s_bcast_seq;
 
+    struct ble_hs_adv_fields fields = {0};
+    fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
     uint16_t svc_uuid = BLE_SVC_UUID;
     fields.uuids16 = (ble_uuid16_t[]){ BLE_UUID16_INIT(svc_uuid) };
     fields.num_uuids16 = 1; fields.uuids16_is_complete = 1;
+    fields.mfg_data = mfg;
+    fields.mfg_data_len = sizeof(mfg);
+    return ble_gap_adv_set_fields(&fields);
+}
 
-    ble_gap_adv_set_fields(&fields);
-
+// (re)start advertising: connectable when idle, broadcast only while connected
+static void adv_start(void) {
+    uint16_t itvl = (uint16_t)(s_adv_itvl_ms * 8 / 5);   // 0.625 ms units
     struct ble_gap_adv_params advp = {0};
-    advp.conn_mode = BLE_GAP_CONN_MODE_UND; advp.disc_mode = BLE_GAP_DISC_MODE_GEN;
-    ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER, &advp, gap_event_cb, NULL);
+    advp.conn_mode = s_conn_handle ? BLE_GAP_CONN_MODE_NON : BLE_GAP_CONN_MODE_UND;
+    advp.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    advp.itvl_min = itvl; advp.itvl_max = itvl;
+    if (ble_gap_adv_active()) ble_gap_adv_stop();
+    int rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER, &advp, gap_event_cb, NULL);
+    if (rc != 0) ESP_LOGW(TAG, "adv start failed: %d", rc);
+}
+
+// caller holds s_adv_mtx
+static void adv_update_locked(void) {
+    uint8_t now[BCAST_LEN];
+    bcast_pack(now);
+    if (memcmp(now, s_bcast, BCAST_LEN) != 0) {
+        memcpy(s_bcast, now, BCAST_LEN);
+        s_bcast_seq++;
+        int rc = adv_set_data();
+        if (rc != 0) ESP_LOGW(TAG, "adv data update failed: %d", rc);
+    }
+}
+
+// never blocks the caller: if the lock is taken, its holder repacks on release
+void ble_alarm_adv_refresh(void) {
+    if (!s_synced) return;
+    s_adv_pending = true;
+    while (s_adv_pending && xSemaphoreTake(s_adv_mtx, 0) == pdTRUE) {
+        s_adv_pending = false;
+        adv_update_locked();
+        xSemaphoreGive(s_adv_mtx);
+    }
+}
+
+esp_err_t ble_alarm_set_adv_interval(uint16_t ms) {
+    if (ms < ADV_ITVL_MIN_MS || ms > ADV_ITVL_MAX_MS) return ESP_ERR_INVALID_ARG;
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(BLE_NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) return err;
+    err = nvs_set_u16(h, BLE_NVS_KEY_ITVL, ms);
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+    if (err != ESP_OK) return err;
+
+    xSemaphoreTake(s_adv_mtx, portMAX_DELAY);
+    s_adv_itvl_ms = ms;
+    if (s_synced) adv_start();
+    xSemaphoreGive(s_adv_mtx);
+    if (s_adv_pending) ble_alarm_adv_refresh();
+    ESP_LOGI(TAG, "Advertising every %u ms", ms);
+    return ESP_OK;
+}
+
+static void load_adv_interval(void) {
+    nvs_handle_t h;
+    uint16_t ms;
+    if (nvs_open(BLE_NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+    if (nvs_get_u16(h, BLE_NVS_KEY_ITVL, &ms) == ESP_OK && ms >= ADV_ITVL_MIN_MS && ms <= ADV_ITVL_MAX_MS)
+        s_adv_itvl_ms = ms;
+    nvs_close(h);
+}
+
+static void ble_advertise(void) {
+    struct ble_hs_adv_fields rsp = {0};
+    const char *name = ble_svc_gap_device_name();
+    rsp.name = (uint8_t*)name;
+    rsp.name_len = (uint8_t)strlen(name);
+    rsp.name_is_complete = 1;
+    ble_gap_adv_rsp_set_fields(&rsp);
+
+    xSemaphoreTake(s_adv_mtx, portMAX_DELAY);
+    bcast_pack(s_bcast);
+    adv_set_data();
+    adv_start();
+    s_synced = true;
+    xSemaphoreGive(s_adv_mtx);
+    if (s_adv_pending) ble_alarm_adv_refresh();
 }
 
 static void on_sync(void) {
@@ -181,6 +630,8 @@ static void host_task(void *param) {
 
 esp_err_t ble_alarm_init(void)
 {
+    s_adv_mtx = xSemaphoreCreateMutex();
+    load_adv_interval();
     ESP_ERROR_CHECK(nimble_port_init());
     ble_hs_cfg.reset_cb = on_reset;
     ble_hs_cfg.sync_cb  = on_sync;
@@ -191,6 +642,7 @@ esp_err_t ble_alarm_init(void)
     ble_gatts_add_svcs(gatt_svcs);
 
     nimble_port_freertos_init(host_task);
+
     ESP_LOGI(TAG, "BLE init done, advertising...");
     return ESP_OK;
 }
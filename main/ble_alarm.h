@@ -10,3 +10,9 @@ void ble_alarm_notify_ringing(uint8_t ringing);
 
 
 void ble_alarm_refresh_alarm_time(void);
+
+// re-pack the broadcast state and update the advertisement if it changed
+void ble_alarm_adv_refresh(void);
+
+// 100..10240 ms, stored in NVS; longer saves power, shorter reaches scanners sooner
+esp_err_t ble_alarm_set_adv_interval(uint16_t ms);
@@ -5,279 +5,239 @@
 #include "freertos/queue.h"
 #include "time_svc.h"
 #include "alarm_task.h"
+#include "display.h"
+#include "chrono.h"
+#include "button_fsm.h"
+#include "latency.h"
+#include "ui_fsm.h"
+#include "ble_alarm.h"
 
 static const char *TAGB = "button";
 static QueueHandle_t gpio_evt_queue = NULL;
 
-typedef struct { uint32_t gpio; int64_t t_us; } btn_evt_t;
+#define BTN_COUNT 4
+static const gpio_num_t s_btn_gpio[BTN_COUNT] = { BUTTON_GPIO, BUTTON2_GPIO, BUTTON3_GPIO, BUTTON4_GPIO };
 
+// type BTN_EV_NONE is a raw edge from the ISR that starts the sampler
+typedef struct { uint8_t btn; uint8_t type; uint32_t held_ms; int64_t t_us; } btn_evt_t;
 
-static volatile int64_t s_last_btn1_us = -1;
-static volatile int64_t s_last_btn2_us = -1;
-static volatile int64_t s_last_btn3_us = -1;
-static volatile int64_t s_last_btn4_us = -1;
-
-
-static volatile int64_t s_btn3_press_us = -1;
-static volatile int64_t s_btn4_press_us = -1;
-
-static const int64_t HOLD_CONFIRM_US = 1000000; 
-
-
-static void handle_button1_normal(void);
-static void handle_button2_normal(void);
-
-static inline int wrap(int v, int lo, int hi);
-static void alarm_enter_or_toggle_field(void);
-static void alarm_confirm_if_holding(int64_t held_us);
-static void handle_btn1_alarm(void);
-static void handle_btn2_alarm(void);
-
-
-static void cd_enter_or_toggle_field(void);
-static void cd_confirm_if_holding(int64_t held_us);
-static void handle_btn1_cd(void);
-static void handle_btn2_cd(void);
-
+static btn_fsm_t s_fsm[BTN_COUNT];
+static volatile int64_t s_edge_us[BTN_COUNT];
+static volatile bool s_sampling = false;
+static esp_timer_handle_t s_sample_timer = NULL;
+static ui_t s_ui;
 
 
 static inline bool is_active_low_pressed(gpio_num_t gpio) {
     return gpio_get_level(gpio) == 0;
 }
 
+/* Only timestamps the edge; levels are read by the sampler, so a bounce
+ * cannot be mistaken for the opposite edge. */
 static void IRAM_ATTR button_isr_handler(void *arg)
 {
-    uint32_t gpio_num = (uint32_t)arg;
-    btn_evt_t e = { .gpio = gpio_num, .t_us = esp_timer_get_time() };
-    BaseType_t hpw = pdFALSE;
-    if (gpio_evt_queue) {
+    uint32_t idx = (uint32_t)arg;
+    s_edge_us[idx] = esp_timer_get_time();
+    if (!s_sampling && gpio_evt_queue) {
+        s_sampling = true;
+        btn_evt_t e = { .btn = (uint8_t)idx, .type = BTN_EV_NONE, .t_us = s_edge_us[idx] };
+        BaseType_t hpw = pdFALSE;
         xQueueSendFromISR(gpio_evt_queue, &e, &hpw);
         if (hpw) portYIELD_FROM_ISR();
     }
 }
 
-
-static void handle_button1_normal(void)
+/* Every BTN_SAMPLE_US while any button is busy; stops once all are idle. */
+static void button_sample_cb(void *arg)
 {
- 
-    if (s_mode == MODE_ALARM_SET) return;
-
-    if (s_mode == MODE_SW) {
-        s_mode = MODE_TIME;
-        s_force_refresh = true;
-        return;
+    int64_t now = esp_timer_get_time();
+    bool idle = true;
+    for (int i = 0; i < BTN_COUNT; ++i) {
+        btn_fsm_ev_t ev[BTN_FSM_MAX_EVENTS];
+        int n = btn_fsm_sample(&s_fsm[i], is_active_low_pressed(s_btn_gpio[i]), s_edge_us[i], now, ev);
+        for (int k = 0; k < n; ++k) {
+            btn_evt_t e = { .btn = (uint8_t)i, .type = ev[k].type, .held_ms = ev[k].held_ms, .t_us = ev[k].edge_us };
+            (void)xQueueSend(gpio_evt_queue, &e, 0);
+        }
+        if (!btn_fsm_idle(&s_fsm[i])) idle = false;
+    }
+    if (!idle) return;
+
+    esp_timer_stop(s_sample_timer);
+    s_sampling = false;
+    // an edge that raced the flag was not reported by the ISR; catch it here
+    for (int i = 0; i < BTN_COUNT; ++i) {
+        if (is_active_low_pressed(s_btn_gpio[i]) != s_fsm[i].pressed) {
+            s_sampling = true;
+            esp_timer_start_periodic(s_sample_timer, BTN_SAMPLE_US);
+            return;
+        }
     }
-
-    s_mode = (display_mode_t)((s_mode + 1) % MODE_SW);
-    if (s_mode == MODE_SW) s_mode = MODE_TIME;
-    s_force_refresh = true;
 }
 
 
-static void handle_button2_normal(void)
-{
-    if (s_mode != MODE_SW) {
-        s_mode = MODE_SW;
-        s_sw_state = SW_RESET_SHOWN;
-        s_sw_mm = 0; s_sw_ss = 0;
-        s_force_refresh = true;
-        return;
-    }
+/* ---- ui_fsm side effects ---- */
 
-    if (s_sw_state == SW_RESET_SHOWN)      s_sw_state = SW_RUNNING;
-    else if (s_sw_state == SW_RUNNING)     s_sw_state = SW_PAUSED;
-    else /* PAUSED */ {
-        s_sw_state = SW_RESET_SHOWN;
-        s_sw_mm = 0; s_sw_ss = 0;
-    }
-    s_force_refresh = true;
-}
-
-static inline int wrap(int v, int lo, int hi) {
-    if (v < lo) return hi;
-    if (v > hi) return lo;
-    return v;
+static void env_stop_ring(void *ctx)
+{
+    s_alarm_ringing = false;
+    alarm_send_stop_ring();
+    ESP_LOGW(TAGB, "Ring stopped by button.");
 }
 
+static void env_snooze(void *ctx)       { alarm_send_snooze(); }
+static void env_confirm_beep(void *ctx) { alarm_send_confirm_beep(); }
 
-static void alarm_enter_or_toggle_field(void)
+static void env_now_hm(void *ctx, uint8_t *hour, uint8_t *min)
 {
-    if (s_alarm_ringing) {
-        s_alarm_ringing = false;
-        alarm_send_stop_ring();
-        ESP_LOGW(TAGB, "Alarm stopped by BTN3.");
-        return;
-    }
-
-    if (s_mode != MODE_ALARM_SET) {
-        struct tm nowtm;
-        time_svc_get_localtime(&nowtm);
-        s_alarm_hour = nowtm.tm_hour;
-        s_alarm_min  = nowtm.tm_min;
-
-        s_mode = MODE_ALARM_SET;
-        s_alarm_sel = ALARM_SEL_HOUR;  
-        s_blink_on = true;
-        s_force_refresh = true;
-        ESP_LOGI(TAGB, "Enter ALARM SET from %02d:%02d (edit HOUR).",
-                 s_alarm_hour, s_alarm_min);
-    } else {
-        s_alarm_sel = (s_alarm_sel == ALARM_SEL_HOUR) ? ALARM_SEL_MIN : ALARM_SEL_HOUR;
-        s_force_refresh = true;
-        ESP_LOGI(TAGB, "Switch edit field: %s", (s_alarm_sel==ALARM_SEL_HOUR)?"HOUR":"MIN");
-    }
+    struct tm nowtm;
+    time_svc_get_localtime(&nowtm);
+    *hour = (uint8_t)nowtm.tm_hour;
+    *min  = (uint8_t)nowtm.tm_min;
 }
 
-static void alarm_confirm_if_holding(int64_t held_us)
+static void env_sw(void *ctx, ui_sw_op_t op)
 {
-    if (held_us >= HOLD_CONFIRM_US && s_mode == MODE_ALARM_SET) {
-        s_alarm_enabled = true;
-        s_force_refresh = true;
-        ESP_LOGI(TAGB, "Alarm saved: %02d:%02d", s_alarm_hour, s_alarm_min);
-
-        alarm_send_confirm_beep();
-
-        s_mode = MODE_TIME;
-        s_force_refresh = true;
+    switch (op) {
+    case UI_SW_START: sw_start(); break;
+    case UI_SW_PAUSE: sw_pause(); break;
+    case UI_SW_RESET: sw_reset(); break;
+    case UI_SW_LAP:
+        if (sw_lap()) ESP_LOGI(TAGB, "Lap %u: %lld ms", (unsigned)sw_lap_total(),
+                               (long long)(sw_elapsed_us() / 1000));
+        break;
     }
 }
 
-static void handle_btn1_alarm(void) {   
-    if (s_alarm_sel == ALARM_SEL_HOUR) s_alarm_hour = wrap(s_alarm_hour + 1, 0, 23);
-    else                                s_alarm_min  = wrap(s_alarm_min  + 1, 0, 59);
-    s_force_refresh = true;
+static bool env_alarm_save(void *ctx, uint8_t edit_id, uint8_t hour, uint8_t min)
+{
+    alarm_entry_t a;
+    bool ok;
+    if (edit_id && alarm_get(edit_id, &a)) {
+        a.hour = hour; a.min = min;
+        a.enabled = true;
+        a.snooze_us = 0;
+        ok = alarm_update(edit_id, &a);
+    } else {
+        // a new daily alarm; the first one becomes the primary
+        a = (alarm_entry_t){ .hour = hour, .min = min, .wday_mask = ALARM_WDAY_ALL, .enabled = true };
+        if (!alarm_get(ALARM_ID_PRIMARY, &(alarm_entry_t){0})) a.id = ALARM_ID_PRIMARY;
+        ok = alarm_add(&a) > 0;
+    }
+    ESP_LOGI(TAGB, "Alarm %s: %02u:%02u", ok ? "saved" : "NOT saved", hour, min);
+    return ok;
 }
 
-static void handle_btn2_alarm(void) {   
-    if (s_alarm_sel == ALARM_SEL_HOUR) s_alarm_hour = wrap(s_alarm_hour - 1, 0, 23);
-    else                                s_alarm_min  = wrap(s_alarm_min  - 1, 0, 59);
-    s_force_refresh = true;
+static bool env_alarm_delete(void *ctx, uint8_t id)
+{
+    bool ok = alarm_delete(id);
+    if (ok) ESP_LOGI(TAGB, "Alarm id=%u deleted", id);
+    return ok;
 }
 
-static void cd_enter_or_toggle_field(void)
+static bool env_alarm_next(void *ctx, uint8_t after_id, uint8_t *id, uint8_t *hour, uint8_t *min)
 {
-    if (s_alarm_ringing) {
-        s_alarm_ringing = false;
-        alarm_send_stop_ring();
-        ESP_LOGW(TAGB, "Ring stopped by BTN4.");
-
-        if (s_mode == MODE_COUNTDOWN_RUN && !s_cd_running) {
-            s_mode = MODE_TIME;
-            s_force_refresh = true;
-        }
-        return;
-    }
-
-    if (s_mode != MODE_COUNTDOWN_SET && s_mode != MODE_COUNTDOWN_RUN) {
-        s_cd_min = 15; s_cd_sec = 0;
-        s_cd_running = false;
-        s_cd_sel = CD_SEL_MIN;
-        s_mode = MODE_COUNTDOWN_SET;
-        s_blink_on = true;
-        s_force_refresh = true;
-        ESP_LOGI(TAGB, "Enter COUNTDOWN SET (15:00) edit MIN.");
-    } else if (s_mode == MODE_COUNTDOWN_SET) {
-        s_cd_sel = (s_cd_sel == CD_SEL_MIN) ? CD_SEL_SEC : CD_SEL_MIN;
-        s_force_refresh = true;
-        ESP_LOGI(TAGB, "COUNTDOWN toggle field: %s", (s_cd_sel==CD_SEL_MIN)?"MIN":"SEC");
-    } else {
+    static alarm_entry_t list[ALARM_TABLE_MAX];
+    int n = alarm_list(list, ALARM_TABLE_MAX);
+    const alarm_entry_t *next = NULL;
+    for (int i = 0; i < n; ++i) {
+        if (list[i].id > after_id && (!next || list[i].id < next->id)) next = &list[i];
     }
+    if (!next) return false;
+    *id = next->id; *hour = next->hour; *min = next->min;
+    return true;
 }
 
-static void cd_confirm_if_holding(int64_t held_us)
+static int env_cd_start(void *ctx, uint32_t seconds)
 {
-    if (held_us >= HOLD_CONFIRM_US && s_mode == MODE_COUNTDOWN_SET) {
-        s_cd_running = true;
-        s_mode = MODE_COUNTDOWN_RUN;
-        s_force_refresh = true;
-        alarm_send_confirm_beep();  
-        ESP_LOGI(TAGB, "COUNTDOWN started: %02d:%02d", s_cd_min, s_cd_sec);
-    }
+    int id = cd_start((int64_t)seconds * 1000000LL);
+    if (id < 0) ESP_LOGW(TAGB, "COUNTDOWN: all %d timers in use", CD_MAX_TIMERS);
+    else        ESP_LOGI(TAGB, "COUNTDOWN id=%d started: %02u:%02u", id,
+                         (unsigned)(seconds / 60), (unsigned)(seconds % 60));
+    return id;
 }
 
-static void handle_btn1_cd(void) {  
-    if (s_cd_sel == CD_SEL_MIN) s_cd_min = wrap(s_cd_min + 1, 0, 99);
-    else                        s_cd_sec = wrap(s_cd_sec + 1, 0, 59);
-    s_force_refresh = true;
+static bool env_cd_cancel(void *ctx, uint8_t id)  { return cd_cancel(id); }
+static bool env_cd_running(void *ctx, uint8_t id) { return cd_is_running(id); }
+
+static uint8_t env_cd_next(void *ctx, uint8_t after_id)
+{
+    cd_info_t list[CD_MAX_TIMERS];
+    int n = cd_list(list, CD_MAX_TIMERS);
+    if (!n) return 0;
+    int k = 0;
+    while (k < n && list[k].id <= after_id) ++k;
+    return list[k < n ? k : 0].id;
 }
 
-static void handle_btn2_cd(void) {  
-    if (s_cd_sel == CD_SEL_MIN) s_cd_min = wrap(s_cd_min - 1, 0, 99);
-    else                        s_cd_sec = wrap(s_cd_sec - 1, 0, 59);
-    s_force_refresh = true;
+static const ui_env_t s_ui_env = {
+    .stop_ring    = env_stop_ring,
+    .snooze       = env_snooze,
+    .confirm_beep = env_confirm_beep,
+    .now_hm       = env_now_hm,
+    .sw           = env_sw,
+    .alarm_save   = env_alarm_save,
+    .alarm_delete = env_alarm_delete,
+    .alarm_next   = env_alarm_next,
+    .cd_start     = env_cd_start,
+    .cd_cancel    = env_cd_cancel,
+    .cd_running   = env_cd_running,
+    .cd_next      = env_cd_next,
+};
+
+static inline bool is_edit_mode(display_mode_t m) {
+    return m == MODE_ALARM_SET || m == MODE_COUNTDOWN_SET;
 }
 
+// copy the UI state to the globals the display and BLE read
+static void ui_publish(display_mode_t from)
+{
+    const ui_state_t *st = &s_ui.st;
+    if (is_edit_mode(st->mode) && st->mode != from) s_blink_on = true;
+    s_sw_state   = st->sw;
+    s_alarm_sel  = st->alarm_sel;
+    s_cd_sel     = st->cd_sel;
+    s_cd_min     = st->cd_min;
+    s_cd_sec     = st->cd_sec;
+    s_cd_view_id = st->cd_view_id;
+    // outside the editor these mirror the primary alarm (alarm_task)
+    bool moved = st->mode == MODE_ALARM_SET
+              && (s_alarm_hour != st->alarm_hour || s_alarm_min != st->alarm_min);
+    if (st->mode == MODE_ALARM_SET) { s_alarm_hour = st->alarm_hour; s_alarm_min = st->alarm_min; }
+    s_mode = st->mode;
+    if (moved) ble_alarm_adv_refresh();
+}
 
 static void button_task(void *arg)
 {
     btn_evt_t e;
-    const int64_t debounce_us = (int64_t)DEBOUNCE_MS * 1000LL;
 
     while (1) {
-        if (xQueueReceive(gpio_evt_queue, &e, portMAX_DELAY)) {
-            bool is_press = (gpio_get_level(e.gpio) == 0);  
-
-            if (e.gpio == BUTTON_GPIO) {
-                if (s_last_btn1_us < 0 || (e.t_us - s_last_btn1_us) > debounce_us) {
-                    s_last_btn1_us = e.t_us;
-                    if (is_press) {
-                        alarm_send_click_beep();
-                        if      (s_mode == MODE_ALARM_SET)         handle_btn1_alarm();
-                        else if (s_mode == MODE_COUNTDOWN_SET)     handle_btn1_cd();
-                        else                                        handle_button1_normal();
-                        ESP_LOGI(TAGB, "BTN1 press");
-                    }
-                }
-
-            } else if (e.gpio == BUTTON2_GPIO) {
-                if (s_last_btn2_us < 0 || (e.t_us - s_last_btn2_us) > debounce_us) {
-                    s_last_btn2_us = e.t_us;
-                    if (is_press) {
-                        alarm_send_click_beep();
-                        if      (s_mode == MODE_ALARM_SET)         handle_btn2_alarm();
-                        else if (s_mode == MODE_COUNTDOWN_SET)     handle_btn2_cd();
-                        else                                        handle_button2_normal();
-                        ESP_LOGI(TAGB, "BTN2 press");
-                    }
-                }
-
-            } else if (e.gpio == BUTTON3_GPIO) {
-                if (is_press) {
-                    if (s_last_btn3_us < 0 || (e.t_us - s_last_btn3_us) > debounce_us) {
-                        s_last_btn3_us = e.t_us;
-                        s_btn3_press_us = e.t_us; 
-                        alarm_send_click_beep();
-                        alarm_enter_or_toggle_field();
-                        ESP_LOGI(TAGB, "BTN3 press");
-                    }
-                } else {
-                    if (s_btn3_press_us > 0) {
-                        int64_t held = e.t_us - s_btn3_press_us;
-                        s_btn3_press_us = -1;
-                        alarm_confirm_if_holding(held);
-                        ESP_LOGI(TAGB, "BTN3 release held=%lldms", (long long)(held/1000));
-                    }
-                }
-
-            } else if (e.gpio == BUTTON4_GPIO) {
-                if (is_press) {
-                    if (s_last_btn4_us < 0 || (e.t_us - s_last_btn4_us) > debounce_us) {
-                        s_last_btn4_us = e.t_us;
-                        s_btn4_press_us = e.t_us; 
-                        alarm_send_click_beep();
-                        cd_enter_or_toggle_field();   
-                        ESP_LOGI(TAGB, "BTN4 press");
-                    }
-                } else {
-                    if (s_btn4_press_us > 0) {
-                        int64_t held = e.t_us - s_btn4_press_us;
-                        s_btn4_press_us = -1;
-                        cd_confirm_if_holding(held); 
-                        ESP_LOGI(TAGB, "BTN4 release held=%lldms", (long long)(held/1000));
-                    }
-                }
-            }
+        if (!xQueueReceive(gpio_evt_queue, &e, portMAX_DELAY)) continue;
+        if (e.type == BTN_EV_NONE) {
+            // fails harmlessly if the sampler is already running
+            esp_timer_start_periodic(s_sample_timer, BTN_SAMPLE_US);
+            continue;
         }
+        if (e.type == BTN_EV_PRESS) alarm_send_click_beep();
+
+        ui_ev_t ev = ui_ev_from_button(e.btn, e.type, e.held_ms);
+        if (ev != UI_EV_NONE) {
+            s_ui.st.ringing = s_alarm_ringing;
+            display_mode_t from = s_ui.st.mode;
+            const char *act = ui_dispatch(&s_ui, ev);
+            ui_publish(from);
+            // the "ui> event" part replays with ui_replay
+            ESP_LOGI(TAGB, "ui> %s  # %s -> %s %s", ui_ev_name(ev), ui_mode_name(from),
+                     ui_mode_name(s_ui.st.mode), act ? act : "-");
+        }
+        // holding BTN1/BTN2 scrolls the value being edited
+        if (e.type == BTN_EV_PRESS && e.btn < 2) s_fsm[e.btn].repeat = is_edit_mode(s_ui.st.mode);
+
+        // nothing to redraw, and releases the UI ignores would skew the percentiles
+        if (ev == UI_EV_NONE) continue;
+        lat_record(LAT_INPUT, esp_timer_get_time() - e.t_us);
+        display_request_refresh_from(e.t_us);
     }
 }
 
@@ -295,12 +255,19 @@ void button_init_and_start(void)
     };
     ESP_ERROR_CHECK(gpio_config(&io));
 
-    gpio_evt_queue = xQueueCreate(10, sizeof(btn_evt_t));
+    ui_init(&s_ui, &s_ui_env, NULL);
+    for (int i = 0; i < BTN_COUNT; ++i) btn_fsm_init(&s_fsm[i]);
+    const esp_timer_create_args_t targs = {
+        .callback = button_sample_cb,
+        .name = "btn_sample",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&targs, &s_sample_timer));
+
+    gpio_evt_queue = xQueueCreate(16, sizeof(btn_evt_t));
     ESP_ERROR_CHECK(gpio_install_isr_service(0));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(BUTTON_GPIO,  button_isr_handler, (void *)(uint32_t)BUTTON_GPIO));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(BUTTON2_GPIO, button_isr_handler, (void *)(uint32_t)BUTTON2_GPIO));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(BUTTON3_GPIO, button_isr_handler, (void *)(uint32_t)BUTTON3_GPIO));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(BUTTON4_GPIO, button_isr_handler, (void *)(uint32_t)BUTTON4_GPIO)); // THÊM BTN4
+    for (int i = 0; i < BTN_COUNT; ++i) {
+        ESP_ERROR_CHECK(gpio_isr_handler_add(s_btn_gpio[i], button_isr_handler, (void *)(uint32_t)i));
+    }
 
     xTaskCreate(button_task, "button_task", 3072, NULL, 10, NULL);
 }
@@ -0,0 +1,67 @@
+#include <string.h>
+#include "button_fsm.h"
+
+void btn_fsm_init(btn_fsm_t *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->release_us = -1;
+}
+
+static void emit(btn_fsm_ev_t *out, int *n, uint8_t type, int64_t held_us, int64_t edge_us)
+{
+    out[*n].type = type;
+    out[*n].held_ms = held_us > 0 ? (uint32_t)(held_us / 1000) : 0;
+    out[*n].edge_us = edge_us;
+    (*n)++;
+}
+
+int btn_fsm_sample(btn_fsm_t *b, bool raw_pressed, int64_t edge_us, int64_t now_us,
+                   btn_fsm_ev_t *out)
+{
+    int n = 0;
+
+    if (raw_pressed != b->pressed) {
+        // a bounce resets the count; the first disagreeing sample names the edge
+        if (b->count++ == 0) b->change_us = edge_us > 0 ? edge_us : now_us;
+        if (b->count >= BTN_STABLE_SAMPLES) {
+            b->count = 0;
+            b->pressed = raw_pressed;
+            if (raw_pressed) {
+                bool dbl = b->release_us >= 0 && b->change_us - b->release_us <= BTN_DOUBLE_US;
+                b->press_us = b->change_us;
+                b->long_sent = false;
+                b->next_repeat_us = b->press_us + BTN_REPEAT_DELAY_US;
+                emit(out, &n, BTN_EV_PRESS, 0, b->change_us);
+                if (dbl) {
+                    emit(out, &n, BTN_EV_DOUBLE, 0, b->change_us);
+                    b->release_us = -1;   // a third press starts over
+                }
+            } else {
+                b->release_us = b->change_us;
+                emit(out, &n, BTN_EV_RELEASE, b->change_us - b->press_us, b->change_us);
+                b->repeat = false;
+            }
+        }
+        return n;
+    }
+    b->count = 0;
+
+    if (b->pressed) {
+        int64_t held = now_us - b->press_us;
+        if (!b->long_sent && held >= BTN_LONG_US) {
+            b->long_sent = true;
+            emit(out, &n, BTN_EV_LONG, held, now_us);
+        }
+        if (b->repeat && now_us >= b->next_repeat_us) {
+            emit(out, &n, BTN_EV_REPEAT, held, now_us);
+            b->next_repeat_us += held >= BTN_REPEAT_FAST_AFTER_US ? BTN_REPEAT_FAST_US : BTN_REPEAT_US;
+            if (b->next_repeat_us < now_us) b->next_repeat_us = now_us;
+        }
+    }
+    return n;
+}
+
+bool btn_fsm_idle(const btn_fsm_t *b)
+{
+    return !b->pressed && b->count == 0;
+}
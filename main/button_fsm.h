@@ -0,0 +1,62 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-button debounce and gesture state machine, fed one level sample
+ * every BTN_SAMPLE_US. Plain C so it also runs off target. */
+
+#define BTN_SAMPLE_US         5000
+#define BTN_STABLE_SAMPLES    4         // 20 ms of agreeing samples = a real edge
+#define BTN_LONG_US           1000000   // long-press, sent once while still held
+#define BTN_DOUBLE_US         300000    // press this soon after a release = double-click
+#define BTN_REPEAT_DELAY_US   400000
+#define BTN_REPEAT_US         100000
+#define BTN_REPEAT_FAST_US    40000     // after BTN_REPEAT_FAST_AFTER_US of repeating
+#define BTN_REPEAT_FAST_AFTER_US 1500000
+
+typedef enum {
+    BTN_EV_NONE = 0,
+    BTN_EV_PRESS,
+    BTN_EV_RELEASE,
+    BTN_EV_LONG,
+    BTN_EV_REPEAT,
+    BTN_EV_DOUBLE
+} btn_ev_type_t;
+
+typedef struct {
+    uint8_t  type;      // btn_ev_type_t
+    uint32_t held_ms;   // RELEASE, LONG, REPEAT: time since the press
+    int64_t  edge_us;   // PRESS, DOUBLE, RELEASE: first edge of the change;
+                        // LONG, REPEAT: the sample that produced it
+} btn_fsm_ev_t;
+
+typedef struct {
+    bool    pressed;          // debounced state
+    uint8_t count;            // consecutive samples disagreeing with pressed
+    bool    repeat;           // auto-repeat while held; set by the owner per press
+    bool    long_sent;
+    int64_t change_us;        // edge that started the pending change
+    int64_t press_us;
+    int64_t release_us;       // last release, -1 = none
+    int64_t next_repeat_us;
+} btn_fsm_t;
+
+#define BTN_FSM_MAX_EVENTS 2
+
+void btn_fsm_init(btn_fsm_t *b);
+
+/* Feed one sample. edge_us is the latest edge the ISR saw for this button.
+ * Writes up to BTN_FSM_MAX_EVENTS events to out and returns the count. */
+int  btn_fsm_sample(btn_fsm_t *b, bool raw_pressed, int64_t edge_us, int64_t now_us,
+                    btn_fsm_ev_t *out);
+
+// released, stable and nothing pending: sampling can stop
+bool btn_fsm_idle(const btn_fsm_t *b);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,193 @@
+#include <string.h>
+#include "chrono.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "alarm_task.h"
+#include "display.h"
+
+static const char *TAGC = "chrono";
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static chrono_base_t s_sw;
+static uint32_t s_laps_ms[SW_LAP_MAX];   // ring buffer
+static uint32_t s_lap_count = 0;         // total since reset; head = count % SW_LAP_MAX
+
+#define CD_TICK_US 1000000LL
+
+static tw_wheel_t s_wheel;
+static int64_t s_wheel_epoch_us = 0;    // esp_timer time of wheel tick 0
+static esp_timer_handle_t s_tick_timer = NULL;
+static uint32_t s_cd_duration_s[TW_MAX_TIMERS];   // as requested, by wheel slot
+
+void sw_start(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (!s_sw.running) {
+        s_sw.start_us = now;
+        s_sw.running = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void sw_pause(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    if (s_sw.running) {
+        s_sw.accum_us += now - s_sw.start_us;
+        s_sw.running = false;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void sw_reset(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(&s_sw, 0, sizeof(s_sw));
+    s_lap_count = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+bool sw_lap(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    bool ok = s_sw.running;
+    if (ok) {
+        s_laps_ms[s_lap_count % SW_LAP_MAX] = (uint32_t)(chrono_elapsed_us(&s_sw, now) / 1000);
+        s_lap_count++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return ok;
+}
+
+int64_t sw_elapsed_us(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    int64_t e = chrono_elapsed_us(&s_sw, now);
+    portEXIT_CRITICAL(&s_lock);
+    return e;
+}
+
+int sw_get_laps(uint32_t *out_ms, int max)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t n = s_lap_count < SW_LAP_MAX ? s_lap_count : SW_LAP_MAX;
+    if (n > (uint32_t)max) n = max;
+    for (uint32_t i = 0; i < n; ++i) out_ms[i] = s_laps_ms[(s_lap_count - n + i) % SW_LAP_MAX];
+    portEXIT_CRITICAL(&s_lock);
+    return (int)n;
+}
+
+uint32_t sw_lap_total(void)
+{
+    return s_lap_count;
+}
+
+static inline int64_t tick_us(uint32_t tick)
+{
+    return s_wheel_epoch_us + (int64_t)tick * CD_TICK_US;
+}
+
+/* One wheel tick. Re-armed against the epoch rather than the last
+ * callback, so ticks stay on whole seconds; stops once the wheel is empty. */
+static void cd_tick_cb(void *arg)
+{
+    uint8_t due[CD_MAX_TIMERS];
+    int64_t next = -1;
+
+    portENTER_CRITICAL(&s_lock);
+    int n = tw_tick(&s_wheel, due, CD_MAX_TIMERS);
+    if (s_wheel.count) next = tick_us(s_wheel.now_tick + 1);
+    portEXIT_CRITICAL(&s_lock);
+
+    if (next > 0) {
+        int64_t d = next - esp_timer_get_time();
+        esp_timer_start_once(s_tick_timer, d > 0 ? (uint64_t)d : 1);
+    }
+    for (int i = 0; i < n; ++i) ESP_LOGI(TAGC, "Countdown id=%u done", due[i]);
+    if (n) {
+        alarm_send_start_ring();
+        display_request_refresh();
+    }
+}
+
+int cd_start(int64_t duration_us)
+{
+    if (!s_tick_timer) {
+        const esp_timer_create_args_t targs = {
+            .callback = cd_tick_cb,
+            .name = "cd_wheel",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&targs, &s_tick_timer));
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    bool was_empty = s_wheel.count == 0;
+    if (!s_wheel.next_id) tw_init(&s_wheel);
+    // an idle wheel restarts its tick phase at now, so a lone timer is exact
+    if (was_empty) s_wheel_epoch_us = now - (int64_t)s_wheel.now_tick * CD_TICK_US;
+    int64_t delay = (now + duration_us - tick_us(s_wheel.now_tick) + CD_TICK_US - 1) / CD_TICK_US;
+    int id = tw_add(&s_wheel, delay > 0 ? (uint32_t)delay : 1);
+    if (id > 0) s_cd_duration_s[tw_find(&s_wheel, id) - s_wheel.t] = (uint32_t)(duration_us / 1000000);
+    portEXIT_CRITICAL(&s_lock);
+
+    if (id > 0 && was_empty) {
+        esp_timer_stop(s_tick_timer);
+        esp_timer_start_once(s_tick_timer, CD_TICK_US);
+    }
+    if (id > 0) ESP_LOGI(TAGC, "Countdown id=%d started: %lld s", id, (long long)(duration_us / 1000000));
+    return id;
+}
+
+bool cd_cancel(uint8_t id)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool ok = tw_cancel(&s_wheel, id);
+    portEXIT_CRITICAL(&s_lock);
+    return ok;
+}
+
+bool cd_is_running(uint8_t id)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool r = tw_find(&s_wheel, id) != NULL;
+    portEXIT_CRITICAL(&s_lock);
+    return r;
+}
+
+int64_t cd_remaining_us(uint8_t id)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t r = 0;
+    portENTER_CRITICAL(&s_lock);
+    const tw_timer_t *t = tw_find(&s_wheel, id);
+    if (t) r = tick_us(t->expire_tick) - now;
+    portEXIT_CRITICAL(&s_lock);
+    return r > 0 ? r : 0;
+}
+
+int cd_list(cd_info_t *out, int max)
+{
+    int64_t now = esp_timer_get_time();
+    int n = 0;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < TW_MAX_TIMERS; ++i) {
+        const tw_timer_t *t = &s_wheel.t[i];
+        if (!t->id || n >= max) continue;
+        // insertion sort by id; at most CD_MAX_TIMERS entries
+        int j = n++;
+        while (j > 0 && out[j - 1].id > t->id) { out[j] = out[j - 1]; --j; }
+        out[j].id = t->id;
+        out[j].duration_s = s_cd_duration_s[i];
+        int64_t r = tick_us(t->expire_tick) - now;
+        out[j].remaining_us = r > 0 ? r : 0;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
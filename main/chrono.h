@@ -0,0 +1,56 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "timer_wheel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Stopwatch and countdown on the esp_timer monotonic clock. Elapsed time
+ * is start instant plus time accumulated before the last pause, so it
+ * never drifts and resolves to microseconds. */
+
+typedef struct {
+    int64_t start_us;   // esp_timer time of the last start, valid while running
+    int64_t accum_us;   // elapsed before the last start
+    bool running;
+} chrono_base_t;
+
+static inline int64_t chrono_elapsed_us(const chrono_base_t *b, int64_t now_us)
+{
+    return b->accum_us + (b->running ? now_us - b->start_us : 0);
+}
+
+#define SW_LAP_MAX 16
+
+void    sw_start(void);
+void    sw_pause(void);
+void    sw_reset(void);
+bool    sw_lap(void);                    // false unless running
+int64_t sw_elapsed_us(void);
+// lap splits (elapsed ms at each lap), oldest first; returns count
+int     sw_get_laps(uint32_t *out_ms, int max);
+uint32_t sw_lap_total(void);             // laps taken since reset, including overwritten ones
+
+/* Countdown timers: up to CD_MAX_TIMERS run at once on a hashed timer
+ * wheel ticked every second, and each rings through the alarm path when
+ * it reaches zero. Expiry lands on a wheel tick, at most 1 s past the
+ * requested duration; remaining time is reported against that tick. */
+#define CD_MAX_TIMERS TW_MAX_TIMERS
+
+typedef struct {
+    uint8_t  id;
+    uint32_t duration_s;                 // as given to cd_start()
+    int64_t  remaining_us;
+} cd_info_t;
+
+int     cd_start(int64_t duration_us);      // timer id, or -1 when all are in use
+bool    cd_cancel(uint8_t id);
+bool    cd_is_running(uint8_t id);
+int64_t cd_remaining_us(uint8_t id);        // 0 once expired or cancelled
+int     cd_list(cd_info_t *out, int max);   // ordered by id
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,9 +4,80 @@
 #include "driver/spi_master.h"
 #include "max7219.h"
 #include "time_svc.h"
+#include "esp_timer.h"
+#include "display.h"
+#include "alarm_task.h"
+#include "chrono.h"
+#include "latency.h"
+#include "sensor_dht.h"
 
 static const char *TAGD = "display";
 
+static TaskHandle_t s_display_task = NULL;
+static volatile uint32_t s_wakeups = 0;
+static int64_t s_wakeups_since_us = 0;
+
+/* Latency tracing: the oldest input edge not yet drawn, and the frames
+ * handed to the driver whose flush has not completed (at most two are
+ * in flight, the ring only needs to be a little deeper). */
+static portMUX_TYPE s_lat_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_pending_edge_us = 0;
+static int64_t s_frame_start_us = 0;
+static int64_t s_frame_edge_us = 0;
+
+#define INFLIGHT_MAX 4
+typedef struct { int64_t edge_us; int64_t queued_us; } inflight_t;
+static inflight_t s_inflight[INFLIGHT_MAX];
+static uint8_t s_inflight_head = 0, s_inflight_tail = 0;
+
+void display_request_refresh(void) {
+    s_force_refresh = true;
+    if (s_display_task) xTaskNotifyGive(s_display_task);
+}
+
+void display_request_refresh_from(int64_t edge_us) {
+    portENTER_CRITICAL(&s_lat_lock);
+    if (s_pending_edge_us == 0) s_pending_edge_us = edge_us;
+    portEXIT_CRITICAL(&s_lat_lock);
+    display_request_refresh();
+}
+
+static int64_t take_pending_edge(void) {
+    portENTER_CRITICAL(&s_lat_lock);
+    int64_t e = s_pending_edge_us;
+    s_pending_edge_us = 0;
+    portEXIT_CRITICAL(&s_lat_lock);
+    return e;
+}
+
+// SPI ISR, once per frame that queued rows
+static void IRAM_ATTR on_flush_done(max7219_t *dev, void *arg) {
+    (void)dev; (void)arg;
+    int64_t now = esp_timer_get_time();
+    inflight_t f = { 0 };
+    bool have = false;
+    portENTER_CRITICAL_SAFE(&s_lat_lock);
+    if (s_inflight_tail != s_inflight_head) {
+        f = s_inflight[s_inflight_tail];
+        s_inflight_tail = (s_inflight_tail + 1) % INFLIGHT_MAX;
+        have = true;
+    }
+    portEXIT_CRITICAL_SAFE(&s_lat_lock);
+    if (!have) return;
+    lat_record(LAT_BUS, now - f.queued_us);
+    if (f.edge_us) lat_record(LAT_TOTAL, now - f.edge_us);
+}
+
+void display_get_wakeup_stats(uint32_t *wakeups, int64_t *since_us) {
+    if (wakeups) *wakeups = s_wakeups;
+    if (since_us) *since_us = s_wakeups_since_us;
+}
+
+static inline TickType_t ticks_until(TickType_t last, TickType_t period, TickType_t now) {
+    TickType_t elapsed = now - last;
+    return (elapsed >= period) ? 0 : period - elapsed;
+}
+
 
 static inline uint8_t flip_byte(uint8_t b) {
     b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
@@ -20,11 +91,36 @@ static inline uint8_t shift_down(uint8_t b) {
 }
 
 static void draw_cols_8x32(max7219_t *dev, const uint8_t cols[32]) {
-    for (int m = 0; m < 4; m++) {
-        uint8_t block[8];
-        memcpy(block, &cols[m * 8], 8);
-        max7219_draw_image_8x8(dev, m * 8, block);
+    int64_t now = esp_timer_get_time();
+    lat_record(LAT_RENDER, now - s_frame_start_us);
+
+    // queue before drawing: the ISR may complete the frame before the call returns
+    int64_t edge = s_frame_edge_us;
+    s_frame_edge_us = 0;
+    bool queued = false;
+    portENTER_CRITICAL(&s_lat_lock);
+    uint8_t next = (s_inflight_head + 1) % INFLIGHT_MAX;
+    if (next != s_inflight_tail) {
+        s_inflight[s_inflight_head] = (inflight_t){ edge, now };
+        s_inflight_head = next;
+        queued = true;
     }
+    portEXIT_CRITICAL(&s_lat_lock);
+
+    uint8_t dirty = 0;
+    esp_err_t err = max7219_draw_framebuffer_async(dev, cols, &dirty);
+    if (err == ESP_OK && dirty) return;
+
+    // no completion will come for it; the ISR only pops older frames from the tail
+    if (queued) {
+        portENTER_CRITICAL(&s_lat_lock);
+        s_inflight_head = (s_inflight_head + INFLIGHT_MAX - 1) % INFLIGHT_MAX;
+        portEXIT_CRITICAL(&s_lat_lock);
+    }
+    if (err != ESP_OK) return;
+    // unchanged frame: nothing went on the bus
+    lat_record(LAT_BUS, 0);
+    if (edge) lat_record(LAT_TOTAL, esp_timer_get_time() - edge);
 }
 
 
@@ -88,6 +184,12 @@ static void draw_number_4digits(max7219_t *dev, int n0, int n1, int n2, int n3)
     draw_cols_8x32(dev, cols);
 }
 
+// hundredths to a rounded whole number that fits two digits
+static int c100_to_2digits(int32_t v) {
+    int r = (int)((v >= 0 ? v + 50 : v - 50) / 100);
+    return r < 0 ? 0 : (r > 99 ? 99 : r);
+}
+
 static void draw_wday_3letters(max7219_t *dev, int wday) {
     static const char *WD[] = {"SUN","MON","TUE","WED","THU","FRI","SAT"};
     const char *s = (wday >= 0 && wday <= 6) ? WD[wday] : "SUN";
@@ -115,6 +217,32 @@ static void draw_alarm_HHMM_blink(max7219_t *dev, int hour, int minute, bool bli
 }
 
 
+/* 3x5 digits so MM:SS.hh fits the 32 columns; rows are 3-bit, MSB left. */
+static const uint8_t SMALL_DIGITS[10][5] = {
+    {7,5,5,5,7},{2,6,2,2,7},{7,1,7,4,7},{7,1,7,1,7},{5,5,7,1,1},
+    {7,4,7,1,7},{7,4,7,5,7},{7,1,2,2,2},{7,5,7,5,7},{7,5,7,1,7},
+};
+
+static void draw_sw_MMSShh(max7219_t *dev, int64_t elapsed_us) {
+    int64_t cs = elapsed_us / 10000;
+    int hh = cs % 100, ss = (cs / 100) % 60, mm = (cs / 6000) % 100;
+    const int d[6] = { mm / 10, mm % 10, ss / 10, ss % 10, hh / 10, hh % 10 };
+    static const int x[6] = { 2, 6, 12, 16, 22, 26 };   // left column of each digit
+
+    uint32_t rows[8] = {0};   // bit 31 = leftmost column
+    for (int i = 0; i < 6; ++i)
+        for (int r = 0; r < 5; ++r)
+            rows[r + 1] |= (uint32_t)SMALL_DIGITS[d[i]][r] << (29 - x[i]);
+    rows[2] |= 1u << (31 - 10); rows[4] |= 1u << (31 - 10);   // colon
+    rows[5] |= 1u << (31 - 20);                               // dot
+
+    uint8_t cols[32];
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 8; ++r)
+            cols[c * 8 + r] = (uint8_t)(rows[r] >> (24 - 8 * c));
+    draw_cols_8x32(dev, cols);
+}
+
 static void draw_countdown_MMSS_blink(max7219_t *dev, int mm, int ss, bool blink_on, countdown_sel_t sel) {
     uint8_t cols[32] = {0}, d8[4][8];
     digit_to_cols((mm / 10) % 10, d8[0]);
@@ -136,52 +264,21 @@ static void draw_countdown_MMSS_blink(max7219_t *dev, int mm, int ss, bool blink
 static void display_task(void *arg) {
     int last_min = -1;
     display_mode_t last_mode = (display_mode_t)255;
-    TickType_t sw_last_tick = xTaskGetTickCount();
-    TickType_t cd_last_tick = xTaskGetTickCount();
-    int prev_sw_mm = -1, prev_sw_ss = -1;
+    int64_t prev_sw_cs = -1, prev_cd_s = -1;
+    int shown_valid = 0;   // 1 = unverified time shown, 2 = verified
 
     TickType_t last_blink = xTaskGetTickCount();
     const TickType_t blink_interval = pdMS_TO_TICKS(500);
 
+    s_frame_start_us = esp_timer_get_time();
     while (1) {
         struct tm tm_local;
         time_svc_get_localtime(&tm_local);
 
-        if (s_mode == MODE_SW && s_sw_state == SW_RUNNING) {
-            TickType_t now = xTaskGetTickCount();
-            if ((now - sw_last_tick) >= pdMS_TO_TICKS(1000)) {
-                sw_last_tick = now;
-                int mm = s_sw_mm, ss = s_sw_ss;
-                ss++; if (ss >= 60) { ss = 0; mm++; }
-                if (mm >= 100) { mm = 0; ss = 0; }
-                s_sw_mm = mm; s_sw_ss = ss;
-                s_force_refresh = true;
-            }
-        } else {
-            sw_last_tick = xTaskGetTickCount();
-        }
-
-        if (s_mode == MODE_COUNTDOWN_RUN && s_cd_running) {
-            TickType_t now = xTaskGetTickCount();
-            if ((now - cd_last_tick) >= pdMS_TO_TICKS(1000)) {
-                cd_last_tick = now;
-
-                int mm = s_cd_min, ss = s_cd_sec;
-                if (mm == 0 && ss == 0) {
-                    if (!s_alarm_ringing) {
-                        s_alarm_ringing = true;   
-                    }
-                    s_cd_running = false;
-                } else {
-                    if (ss == 0) { ss = 59; if (mm > 0) mm--; }
-                    else { ss--; }
-                    s_cd_min = mm; s_cd_sec = ss;
-                }
-                s_force_refresh = true;
-            }
-        } else {
-            cd_last_tick = xTaskGetTickCount();
-        }
+        // both read the esp_timer timebase in chrono.c; nothing accumulates here
+        int64_t sw_us = sw_elapsed_us();
+        int64_t cd_us = cd_remaining_us(s_cd_view_id);
+        int64_t cd_s = (cd_us + 999999) / 1000000;   // 00:01 until it really ends
 
         if (s_mode == MODE_ALARM_SET || s_mode == MODE_COUNTDOWN_SET) {
             TickType_t now = xTaskGetTickCount();
@@ -201,21 +298,35 @@ static void display_task(void *arg) {
             need_refresh = true;
             last_mode = s_mode;
             last_min = -1;
-            prev_sw_mm = -1; prev_sw_ss = -1;
+            prev_sw_cs = -1; prev_cd_s = -1;
         }
         if (s_mode == MODE_TIME && tm_local.tm_min != last_min) {
             need_refresh = true;
             last_min = tm_local.tm_min;
         }
-        if (s_mode == MODE_SW && (s_sw_mm != prev_sw_mm || s_sw_ss != prev_sw_ss)) {
+        if (s_mode == MODE_SW && sw_us / 10000 != prev_sw_cs) {
+            need_refresh = true;
+            prev_sw_cs = sw_us / 10000;
+        }
+        if (s_mode == MODE_COUNTDOWN_RUN && cd_s != prev_cd_s) {
             need_refresh = true;
-            prev_sw_mm = s_sw_mm; prev_sw_ss = s_sw_ss;
+            prev_cd_s = cd_s;
         }
 
         if (need_refresh) {
+            s_frame_edge_us = take_pending_edge();
             switch (s_mode) {
             case MODE_TIME:
                 draw_time_HHMM(&g_dev, tm_local.tm_hour, tm_local.tm_min);
+                if (tm_local.tm_year >= (2020 - 1900)) {
+                    int state = time_svc_is_verified() ? 2 : 1;
+                    if (state > shown_valid) {
+                        shown_valid = state;
+                        ESP_LOGI(TAGD, "Boot to %s time on display: %lld ms",
+                                 state == 2 ? "verified" : "unverified",
+                                 (long long)(esp_timer_get_time() / 1000));
+                    }
+                }
                 printf("%02d%02d\n", tm_local.tm_hour, tm_local.tm_min);
                 break;
 
@@ -241,19 +352,23 @@ static void display_task(void *arg) {
                 break; }
 
             case MODE_DHT: {
-                int t = (int)(s_temperature + 0.5f) * 30;
-                int h = (int)(s_humidity + 0.5f) * 35;
+                sp_stats_t st, sh;
+                int t = 0, h = 0;
+                if (sensor_dht_get(&st, &sh)) {
+                    t = c100_to_2digits(st.filtered);
+                    h = c100_to_2digits(sh.filtered);
+                }
                 draw_number_4digits(&g_dev,(t/10)%10,t%10,(h/10)%10,h%10);
                 break; }
 
             case MODE_SW:
-                draw_number_4digits(&g_dev,
-                    (s_sw_mm/10)%10, s_sw_mm%10,
-                    (s_sw_ss/10)%10, s_sw_ss%10);
-                printf("SW %02d%02d [%s]\n",
-                       s_sw_mm, s_sw_ss,
-                       (s_sw_state==SW_RUNNING)?"RUN":
-                       (s_sw_state==SW_PAUSED) ?"PAUSE":"RST");
+                draw_sw_MMSShh(&g_dev, sw_us);
+                if (s_sw_state != SW_RUNNING) {
+                    printf("SW %02d:%02d.%02d [%s]\n",
+                           (int)(sw_us / 60000000) % 100, (int)(sw_us / 1000000) % 60,
+                           (int)(sw_us / 10000) % 100,
+                           (s_sw_state==SW_PAUSED) ?"PAUSE":"RST");
+                }
                 break;
 
             case MODE_ALARM_SET:
@@ -272,12 +387,11 @@ static void display_task(void *arg) {
                        s_blink_on?"*":" ");
                 break;
 
-            case MODE_COUNTDOWN_RUN:
-                draw_number_4digits(&g_dev,
-                    (s_cd_min/10)%10, s_cd_min%10,
-                    (s_cd_sec/10)%10, s_cd_sec%10);
-                printf("CD RUN %02d:%02d\n", s_cd_min, s_cd_sec);
-                break;
+            case MODE_COUNTDOWN_RUN: {
+                int mm = (int)(cd_s / 60) % 100, ss = (int)(cd_s % 60);
+                draw_number_4digits(&g_dev, mm / 10, mm % 10, ss / 10, ss % 10);
+                printf("CD RUN #%u %02d:%02d\n", s_cd_view_id, mm, ss);
+                break; }
 
             default:
                 break;
@@ -285,7 +399,30 @@ static void display_task(void *arg) {
             fflush(stdout);
         }
 
-        vTaskDelay(pdMS_TO_TICKS(50));
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+        if (s_mode == MODE_SW && s_sw_state == SW_RUNNING) {
+            wait = 1;   // hundredths: every tick
+        }
+        if (s_mode == MODE_COUNTDOWN_RUN && cd_is_running(s_cd_view_id)) {
+            // wake as the shown second changes
+            int64_t us = cd_remaining_us(s_cd_view_id) % 1000000;
+            TickType_t w = pdMS_TO_TICKS(us / 1000) + 1;
+            if (w < wait) wait = w;
+        }
+        if (s_mode == MODE_ALARM_SET || s_mode == MODE_COUNTDOWN_SET) {
+            TickType_t w = ticks_until(last_blink, blink_interval, now);
+            if (w < wait) wait = w;
+        }
+        if (s_mode <= MODE_YYYY) {
+            // wake on the next minute boundary
+            TickType_t w = pdMS_TO_TICKS((60 - tm_local.tm_sec) * 1000);
+            if (w < wait) wait = w;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+        s_frame_start_us = esp_timer_get_time();
+        s_wakeups++;
     }
 }
 
@@ -307,9 +444,11 @@ void display_hw_init(void) {
     g_dev.mirrored = false;
     ESP_ERROR_CHECK(max7219_init(&g_dev));
     ESP_ERROR_CHECK(max7219_set_brightness(&g_dev, 8));
+    ESP_ERROR_CHECK(max7219_set_flush_callback(&g_dev, on_flush_done, NULL));
     ESP_LOGI(TAGD, "Display init done");
 }
 
 void display_start_task(void) {
-    xTaskCreate(display_task, "display_task", 4096, NULL, 5, NULL);
+    s_wakeups_since_us = esp_timer_get_time();
+    xTaskCreate(display_task, "display_task", 4096, NULL, 5, &s_display_task);
 }
@@ -1,3 +1,7 @@
 #pragma once
+#include <stdint.h>
 void display_hw_init(void);   
 void display_start_task(void);
+void display_request_refresh(void);
+void display_request_refresh_from(int64_t edge_us);   // edge_us: ISR time of the input behind it
+void display_get_wakeup_stats(uint32_t *wakeups, int64_t *since_us);
@@ -0,0 +1,361 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "history.h"
+
+static const char *TAGH = "history";
+
+#define SECTOR      4096
+#define PAGE        256
+#define MAX_SECTORS 256
+#define HDR_MAGIC   0x54534948u   // "HIST"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t t0;
+    int16_t  temp0, hum0;
+} hist_hdr_t;
+
+/* Record: one tag byte, then the optional fields it announces.
+ *   tag bit0   temperature delta follows (zigzag varint, 0.1 C)
+ *   tag bit1   humidity delta follows (zigzag varint, 0.1 %RH)
+ *   tag bit2-7 seconds since the previous record, 0..61;
+ *              62 = varint (seconds - 62) follows
+ * The largest tag is 0xFB, so 0xFF (erased flash) ends a sector. */
+#define TAG_T      0x01
+#define TAG_H      0x02
+#define DT_ESCAPE  62
+#define REC_MAX    (1 + 5 + 3 + 3)
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_mtx = NULL;
+static esp_timer_handle_t s_flush_timer = NULL;
+static uint16_t s_nsect = 0;
+
+static uint32_t s_t0[MAX_SECTORS];   // time index: sector base times
+static bool     s_used[MAX_SECTORS];
+static uint16_t s_head = 0;          // sector being appended to
+static uint16_t s_tail = 0;          // oldest sector
+static uint32_t s_head_seq = 0;
+static bool     s_empty = true;
+
+static uint32_t s_woff;              // flash offset in head sector of the first pending byte
+static uint8_t  s_buf[PAGE + REC_MAX];
+static uint16_t s_len;               // pending bytes
+
+static uint32_t s_last_t;            // last record (or sector base)
+static bool     s_reopen = false;    // head ends in a torn write: start the next sector
+static int16_t  s_last_temp, s_last_hum;
+
+static inline uint32_t zigzag(int32_t v)  { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t unzigzag(uint32_t u) { return (int32_t)(u >> 1) ^ -(int32_t)(u & 1); }
+
+static int put_varint(uint8_t *p, uint32_t v)
+{
+    int n = 0;
+    while (v >= 0x80) { p[n++] = (uint8_t)(v | 0x80); v >>= 7; }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int encode(uint8_t *p, uint32_t dt, int32_t dtemp, int32_t dhum)
+{
+    int n = 1;
+    uint8_t tag = (dtemp ? TAG_T : 0) | (dhum ? TAG_H : 0);
+    if (dt < DT_ESCAPE) {
+        tag |= (uint8_t)(dt << 2);
+    } else {
+        tag |= DT_ESCAPE << 2;
+        n += put_varint(p + n, dt - DT_ESCAPE);
+    }
+    p[0] = tag;
+    if (dtemp) n += put_varint(p + n, zigzag(dtemp));
+    if (dhum)  n += put_varint(p + n, zigzag(dhum));
+    return n;
+}
+
+/* ---- sector reader: flash up to the pending bytes, then RAM ---- */
+
+typedef struct {
+    uint16_t sect;
+    uint32_t off;        // offset in sector
+    uint32_t flash_end;  // first offset served from s_buf, SECTOR if none
+    uint8_t  chunk[64];
+    uint32_t chunk_off;
+    uint8_t  chunk_len;
+} reader_t;
+
+static void rd_open(reader_t *r, uint16_t sect)
+{
+    memset(r, 0, sizeof(*r));
+    r->sect = sect;
+    r->off = sizeof(hist_hdr_t);
+    r->flash_end = sect == s_head ? s_woff : SECTOR;
+}
+
+// -1 at the end of the sector's data
+static int rd_byte(reader_t *r)
+{
+    if (r->off >= SECTOR) return -1;
+    if (r->off >= r->flash_end) {
+        uint32_t i = r->off - r->flash_end;
+        if (i >= s_len) return -1;
+        r->off++;
+        return s_buf[i];
+    }
+    if (r->off < r->chunk_off || r->off >= r->chunk_off + r->chunk_len) {
+        uint32_t len = sizeof(r->chunk);
+        if (r->off + len > r->flash_end) len = r->flash_end - r->off;
+        if (esp_partition_read(s_part, (size_t)r->sect * SECTOR + r->off, r->chunk, len) != ESP_OK) return -1;
+        r->chunk_off = r->off;
+        r->chunk_len = (uint8_t)len;
+    }
+    return r->chunk[r->off++ - r->chunk_off];
+}
+
+static bool rd_varint(reader_t *r, uint32_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int b = rd_byte(r);
+        if (b < 0) return false;
+        *v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// next record after rec (updated in place); false at the end of the sector
+static bool rd_record(reader_t *r, hist_rec_t *rec)
+{
+    int tag = rd_byte(r);
+    if (tag < 0 || tag == 0xFF) return false;
+    uint32_t dt = (uint32_t)tag >> 2, u;
+    if (dt == DT_ESCAPE) {
+        if (!rd_varint(r, &u)) return false;
+        dt = DT_ESCAPE + u;
+    }
+    rec->t += dt;
+    if (tag & TAG_T) { if (!rd_varint(r, &u)) return false; rec->temp_c10 += unzigzag(u); }
+    if (tag & TAG_H) { if (!rd_varint(r, &u)) return false; rec->hum_c10 += unzigzag(u); }
+    return true;
+}
+
+static bool read_hdr(uint16_t sect, hist_hdr_t *h)
+{
+    return esp_partition_read(s_part, (size_t)sect * SECTOR, h, sizeof(*h)) == ESP_OK
+        && h->magic == HDR_MAGIC;
+}
+
+/* ---- writing ---- */
+
+// write pending bytes up to the end of the flash page they start in, once that page is complete
+static esp_err_t write_pages(bool partial)
+{
+    while (s_len) {
+        uint32_t room = PAGE - (s_woff % PAGE);
+        if (s_len < room && !partial) break;
+        uint32_t n = s_len < room ? s_len : room;
+        esp_err_t err = esp_partition_write(s_part, (size_t)s_head * SECTOR + s_woff, s_buf, n);
+        if (err != ESP_OK) return err;
+        memmove(s_buf, s_buf + n, s_len - n);
+        s_len -= n;
+        s_woff += n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t open_sector(uint16_t sect, uint32_t t, int16_t temp, int16_t hum)
+{
+    esp_err_t err = esp_partition_erase_range(s_part, (size_t)sect * SECTOR, SECTOR);
+    if (err != ESP_OK) return err;
+    hist_hdr_t h = { .magic = HDR_MAGIC, .seq = s_empty ? 1 : s_head_seq + 1,
+                     .t0 = t, .temp0 = temp, .hum0 = hum };
+    err = esp_partition_write(s_part, (size_t)sect * SECTOR, &h, sizeof(h));
+    if (err != ESP_OK) return err;
+
+    if (!s_empty && sect == s_tail) s_tail = (s_tail + 1) % s_nsect;   // overwrote the oldest
+    if (s_empty) s_tail = sect;
+    s_empty = false;
+    s_head = sect;
+    s_head_seq = h.seq;
+    s_used[sect] = true;
+    s_t0[sect] = t;
+    s_woff = sizeof(h);
+    s_len = 0;
+    s_reopen = false;
+    s_last_t = t; s_last_temp = temp; s_last_hum = hum;
+    return ESP_OK;
+}
+
+static esp_err_t flush_wait(TickType_t wait)
+{
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+    if (xSemaphoreTake(s_mtx, wait) != pdTRUE) return ESP_ERR_TIMEOUT;
+    esp_err_t err = s_empty ? ESP_OK : write_pages(true);
+    xSemaphoreGive(s_mtx);
+    return err;
+}
+
+static void flush_timer_cb(void *arg)
+{
+    hist_flush();
+}
+
+// esp_restart(): don't hang the restart on a writer stuck elsewhere
+static void on_shutdown(void)
+{
+    flush_wait(pdMS_TO_TICKS(100));
+}
+
+static void start_flushing(void)
+{
+    const esp_timer_create_args_t ta = { .callback = flush_timer_cb, .name = "hist_flush" };
+    if (esp_timer_create(&ta, &s_flush_timer) == ESP_OK)
+        esp_timer_start_periodic(s_flush_timer, (uint64_t)HIST_FLUSH_S * 1000000ULL);
+    esp_register_shutdown_handler(on_shutdown);
+}
+
+esp_err_t hist_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, HIST_PARTITION_SUBTYPE, "history");
+    if (!s_part) {
+        ESP_LOGW(TAGH, "No history partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_nsect = s_part->size / SECTOR;
+    if (s_nsect > MAX_SECTORS) s_nsect = MAX_SECTORS;
+    if (s_nsect < 2) return ESP_ERR_INVALID_SIZE;
+    s_mtx = xSemaphoreCreateMutex();
+    start_flushing();
+
+    // rebuild the index from the sector headers
+    uint32_t min_seq = UINT32_MAX;
+    for (uint16_t i = 0; i < s_nsect; ++i) {
+        hist_hdr_t h;
+        s_used[i] = read_hdr(i, &h);
+        if (!s_used[i]) continue;
+        s_t0[i] = h.t0;
+        if (s_empty || h.seq > s_head_seq) { s_head = i; s_head_seq = h.seq; }
+        if (h.seq < min_seq) { s_tail = i; min_seq = h.seq; }
+        s_empty = false;
+    }
+    if (s_empty) {
+        ESP_LOGI(TAGH, "Empty log, %u sectors", s_nsect);
+        return ESP_OK;
+    }
+
+    // find the append point and the last values in the head sector
+    hist_hdr_t h;
+    read_hdr(s_head, &h);
+    hist_rec_t rec = { h.t0, h.temp0, h.hum0 };
+    reader_t r;
+    s_len = 0;
+    s_woff = SECTOR;
+    rd_open(&r, s_head);
+    uint32_t end = r.off;
+    while (rd_record(&r, &rec)) end = r.off;
+    s_woff = end;
+    // bytes past the last whole record were cut off mid-write; flash can't be rewritten in place
+    r.off = end;
+    s_reopen = end < SECTOR && rd_byte(&r) != 0xFF;
+    s_last_t = rec.t; s_last_temp = rec.temp_c10; s_last_hum = rec.hum_c10;
+
+    ESP_LOGI(TAGH, "Log: sectors %u..%u of %u, head at %u bytes, last t=%u",
+             s_tail, s_head, s_nsect, (unsigned)s_woff, (unsigned)s_last_t);
+    return ESP_OK;
+}
+
+esp_err_t hist_add(uint32_t t, int16_t temp_c10, int16_t hum_c10)
+{
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(s_mtx, portMAX_DELAY);
+
+    if (s_empty) {
+        err = open_sector(0, t, temp_c10, hum_c10);
+        goto out;
+    }
+    // a clock stepped back: keep the log (and the index) in time order
+    uint32_t dt = t > s_last_t ? t - s_last_t : 0;
+    if (temp_c10 == s_last_temp && hum_c10 == s_last_hum && dt < HIST_KEEPALIVE_S) goto out;
+
+    uint8_t rec[REC_MAX];
+    int n = encode(rec, dt, temp_c10 - s_last_temp, hum_c10 - s_last_hum);
+    if (s_reopen || s_woff + s_len + n > SECTOR) {
+        // sector full: finish it and start the next with this sample as its base
+        if ((err = write_pages(true)) != ESP_OK) goto out;
+        err = open_sector((s_head + 1) % s_nsect, s_last_t + dt, temp_c10, hum_c10);
+        goto out;
+    }
+    memcpy(s_buf + s_len, rec, n);
+    s_len += n;
+    s_last_t += dt;
+    s_last_temp = temp_c10;
+    s_last_hum = hum_c10;
+    err = write_pages(false);
+
+out:
+    xSemaphoreGive(s_mtx);
+    if (err != ESP_OK) ESP_LOGE(TAGH, "append failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t hist_flush(void)
+{
+    return flush_wait(portMAX_DELAY);
+}
+
+static inline uint16_t ring_sect(uint16_t k) { return (s_tail + k) % s_nsect; }
+
+static uint16_t ring_len(void)
+{
+    return s_empty ? 0 : (uint16_t)((s_head + s_nsect - s_tail) % s_nsect + 1);
+}
+
+int hist_read(uint32_t from, uint32_t to, hist_rec_t *out, int max)
+{
+    if (!s_part || max <= 0) return s_part ? 0 : -1;
+    xSemaphoreTake(s_mtx, portMAX_DELAY);
+
+    // binary search the index for the last sector starting at or before from
+    uint16_t n = ring_len(), lo = 0, hi = n;
+    while (hi - lo > 1) {
+        uint16_t mid = (lo + hi) / 2;
+        if (s_t0[ring_sect(mid)] <= from) lo = mid;
+        else hi = mid;
+    }
+
+    int cnt = 0;
+    for (uint16_t k = lo; k < n && cnt < max; ++k) {
+        uint16_t sect = ring_sect(k);
+        if (s_t0[sect] > to) break;
+        hist_hdr_t h;
+        if (!read_hdr(sect, &h)) continue;
+        hist_rec_t rec = { h.t0, h.temp0, h.hum0 };
+        reader_t r;
+        rd_open(&r, sect);
+        do {
+            if (rec.t > to) break;
+            if (rec.t >= from) out[cnt++] = rec;
+        } while (cnt < max && rd_record(&r, &rec));
+    }
+
+    xSemaphoreGive(s_mtx);
+    return cnt;
+}
+
+bool hist_span(uint32_t *first, uint32_t *last)
+{
+    if (!s_part || s_empty) return false;
+    xSemaphoreTake(s_mtx, portMAX_DELAY);
+    if (first) *first = s_t0[s_tail];
+    if (last) *last = s_last_t;
+    xSemaphoreGive(s_mtx);
+    return true;
+}
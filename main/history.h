@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Temperature/humidity history in the "history" data partition, written
+ * as a ring of 4 KB sectors. A sector starts with a header carrying its
+ * sequence number, base time and base values; records after it hold
+ * varint deltas from the previous record. Only changes are logged, plus
+ * a keepalive every HIST_KEEPALIVE_S, so a stable day takes about 1 KB.
+ * Pending records are written one 256-byte flash page at a time, and the
+ * partial page at least every HIST_FLUSH_S and on esp_restart(). Sector
+ * base times are kept in RAM as the time index for range reads. */
+
+#define HIST_PARTITION_SUBTYPE 0x40
+#define HIST_KEEPALIVE_S       900
+#define HIST_FLUSH_S           900
+
+typedef struct {
+    uint32_t t;          // epoch seconds
+    int16_t  temp_c10;   // 0.1 C
+    int16_t  hum_c10;    // 0.1 %RH
+} hist_rec_t;
+
+esp_err_t hist_init(void);
+
+// t in epoch seconds; dropped while unchanged and within the keepalive
+esp_err_t hist_add(uint32_t t, int16_t temp_c10, int16_t hum_c10);
+
+// write out the partial page (e.g. before a planned restart)
+esp_err_t hist_flush(void);
+
+// up to max records with from <= t <= to, oldest first; returns the count or -1
+int hist_read(uint32_t from, uint32_t to, hist_rec_t *out, int max);
+
+// oldest and newest logged time; false when the log is empty
+bool hist_span(uint32_t *first, uint32_t *last);
+
+#ifdef __cplusplus
+}
+#endif
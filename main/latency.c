@@ -0,0 +1,88 @@
+#include <string.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "latency.h"
+
+static const char *TAG = "latency";
+
+/* Upper bucket edges in us; anything above the last lands in the overflow bucket. */
+static const DRAM_ATTR uint32_t EDGES[] = {
+    100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000,
+    7500, 10000, 15000, 20000, 30000, 50000, 75000, 100000, 200000,
+};
+#define LAT_BUCKETS (sizeof(EDGES) / sizeof(EDGES[0]) + 1)
+
+typedef struct {
+    uint32_t bucket[LAT_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+} lat_hist_t;
+
+static lat_hist_t s_hist[LAT_STAGE_COUNT];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const NAMES[LAT_STAGE_COUNT] = { "input", "render", "bus", "total" };
+
+void IRAM_ATTR lat_record(lat_stage_t stage, int64_t us)
+{
+    if ((unsigned)stage >= LAT_STAGE_COUNT) return;
+    uint32_t v = us < 0 ? 0 : (us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+    unsigned b = 0;
+    while (b < LAT_BUCKETS - 1 && v > EDGES[b]) ++b;
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    lat_hist_t *h = &s_hist[stage];
+    h->bucket[b]++;
+    h->count++;
+    if (v > h->max_us) h->max_us = v;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+static uint32_t percentile(const lat_hist_t *h, uint32_t pct)
+{
+    if (h->count == 0) return 0;
+    uint32_t rank = (uint32_t)(((uint64_t)h->count * pct + 99) / 100);
+    uint32_t seen = 0;
+    for (unsigned b = 0; b < LAT_BUCKETS; ++b) {
+        seen += h->bucket[b];
+        if (seen >= rank) {
+            // the top bucket has no edge, and no bucket is above the max
+            uint32_t edge = b < LAT_BUCKETS - 1 ? EDGES[b] : h->max_us;
+            return edge < h->max_us ? edge : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void lat_get(lat_stage_t stage, lat_summary_t *out)
+{
+    if ((unsigned)stage >= LAT_STAGE_COUNT || !out) return;
+    lat_hist_t h;
+    portENTER_CRITICAL(&s_lock);
+    h = s_hist[stage];
+    portEXIT_CRITICAL(&s_lock);
+
+    out->count = h.count;
+    out->p50_us = percentile(&h, 50);
+    out->p95_us = percentile(&h, 95);
+    out->max_us = h.max_us;
+}
+
+void lat_reset(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_hist, 0, sizeof(s_hist));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void lat_log(void)
+{
+    for (int i = 0; i < LAT_STAGE_COUNT; ++i) {
+        lat_summary_t s;
+        lat_get((lat_stage_t)i, &s);
+        ESP_LOGI(TAG, "%-6s n=%u p50=%uus p95=%uus max=%uus", NAMES[i],
+                 (unsigned)s.count, (unsigned)s.p50_us, (unsigned)s.p95_us, (unsigned)s.max_us);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Button-to-photon latency, split by stage. Each stage keeps a
+ * fixed-bucket histogram; percentiles resolve to a bucket's upper edge. */
+
+typedef enum {
+    LAT_INPUT = 0,   // ISR edge -> button handler done
+    LAT_RENDER,      // display task wake -> frame handed to the driver
+    LAT_BUS,         // frame handed to the driver -> last SPI row sent
+    LAT_TOTAL,       // ISR edge -> last SPI row of the frame showing it
+    LAT_STAGE_COUNT
+} lat_stage_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t max_us;
+} lat_summary_t;
+
+void lat_record(lat_stage_t stage, int64_t us);   // ISR safe
+void lat_get(lat_stage_t stage, lat_summary_t *out);
+void lat_reset(void);
+void lat_log(void);
+
+#ifdef __cplusplus
+}
+#endif
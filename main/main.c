@@ -4,7 +4,7 @@
 #include "display.h"
 #include "button.h"
 #include "sensor_dht.h"
-#include "buzzer.h" 
+#include "history.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "alarm_task.h"
@@ -18,11 +18,12 @@ void app_main(void)
         ESP_ERROR_CHECK(nvs_flash_init());
     }
 
-    ESP_ERROR_CHECK(ble_alarm_init());
     time_svc_init();
+    ESP_ERROR_CHECK(ble_alarm_init());
     display_hw_init();
     wifi_start_task();
     time_svc_start_tasks();
+    hist_init();
     sensor_dht_start_task();
     button_init_and_start();
     display_start_task();
@@ -0,0 +1,344 @@
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include "ntp_race.h"
+
+#define NTP_PORT        123
+#define NTP_PACKET_LEN  48
+#define NTP_UNIX_OFFSET 2208988800ULL   // seconds 1900 -> 1970
+#define NTP_MAX_SERVERS 8
+
+typedef struct {
+    int      fd;
+    uint64_t sent_ts;   // our transmit timestamp, NTP format
+    int64_t  t1_us;
+    bool     done;
+} ntp_slot_t;
+
+static int64_t wall_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint64_t us_to_ntp(int64_t us)
+{
+    uint64_t sec = (uint64_t)(us / 1000000LL) + NTP_UNIX_OFFSET;
+    uint64_t frac = ((uint64_t)(us % 1000000LL) << 32) / 1000000ULL;
+    return (sec << 32) | frac;
+}
+
+static int64_t ntp_to_us(uint64_t ts)
+{
+    int64_t sec = (int64_t)(ts >> 32) - (int64_t)NTP_UNIX_OFFSET;
+    int64_t frac = (int64_t)(((ts & 0xFFFFFFFFULL) * 1000000ULL) >> 32);
+    return sec * 1000000LL + frac;
+}
+
+static void put_ts(uint8_t *p, uint64_t ts)
+{
+    for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(ts >> (56 - 8 * i));
+}
+
+static uint64_t get_ts(const uint8_t *p)
+{
+    uint64_t ts = 0;
+    for (int i = 0; i < 8; ++i) ts = (ts << 8) | p[i];
+    return ts;
+}
+
+// cached address, then a literal, then DNS while time is left, then the fallback
+static bool resolve(ntp_server_t *s, int64_t deadline, struct sockaddr_in *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(s->port ? s->port : NTP_PORT);
+
+    if (s->addr) {
+        out->sin_addr.s_addr = s->addr;
+        return true;
+    }
+    if (s->host && inet_aton(s->host, &out->sin_addr)) {
+        s->addr = out->sin_addr.s_addr;
+        return true;
+    }
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *ai = NULL;
+    if (s->host && wall_us() < deadline && getaddrinfo(s->host, NULL, &hints, &ai) == 0 && ai) {
+        out->sin_addr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+        s->addr = out->sin_addr.s_addr;
+        freeaddrinfo(ai);
+        return true;
+    }
+    // the fallback is not cached, so DNS gets another try next time
+    return s->ip_fallback && inet_aton(s->ip_fallback, &out->sin_addr);
+}
+
+static int open_and_send(const struct sockaddr_in *addr, ntp_slot_t *slot)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t pkt[NTP_PACKET_LEN] = {0};
+    pkt[0] = 0x23;                       // LI 0, VN 4, mode 3 (client)
+    slot->t1_us = wall_us();
+    slot->sent_ts = us_to_ntp(slot->t1_us);
+    put_ts(&pkt[40], slot->sent_ts);     // echoed back as originate
+    if (send(fd, pkt, sizeof(pkt), 0) != sizeof(pkt)) {
+        close(fd);
+        return -1;
+    }
+    slot->fd = fd;
+    return fd;
+}
+
+/* Validate one reply and compute offset/RTT. */
+static bool read_reply(ntp_slot_t *slot, int64_t *offset_us, int64_t *rtt_us)
+{
+    uint8_t pkt[NTP_PACKET_LEN];
+    ssize_t n = recv(slot->fd, pkt, sizeof(pkt), 0);
+    int64_t t4 = wall_us();
+    if (n < NTP_PACKET_LEN) return false;
+
+    int mode = pkt[0] & 0x07, li = pkt[0] >> 6, stratum = pkt[1];
+    if (mode != 4 || li == 3 || stratum == 0 || stratum > 15) return false;
+    if (get_ts(&pkt[24]) != slot->sent_ts) return false;    // not our request
+
+    uint64_t t3_ts = get_ts(&pkt[40]);
+    if (t3_ts == 0) return false;
+    int64_t t2 = ntp_to_us(get_ts(&pkt[32]));
+    int64_t t3 = ntp_to_us(t3_ts);
+    int64_t t1 = slot->t1_us;
+
+    *rtt_us = (t4 - t1) - (t3 - t2);
+    *offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    return *rtt_us >= 0;
+}
+
+bool ntp_race_query(ntp_server_t *servers, int n, ntp_race_mode_t mode,
+                    int timeout_ms, ntp_race_result_t *res)
+{
+    if (!servers || n <= 0 || !res) return false;
+    if (n > NTP_MAX_SERVERS) n = NTP_MAX_SERVERS;
+
+    int64_t deadline = wall_us() + (int64_t)timeout_ms * 1000LL;
+    ntp_slot_t slots[NTP_MAX_SERVERS];
+    struct sockaddr_in addr[NTP_MAX_SERVERS];
+    bool have[NTP_MAX_SERVERS];
+    // all lookups first: a slow one must not delay the other requests
+    for (int i = 0; i < n; ++i) have[i] = resolve(&servers[i], deadline, &addr[i]);
+
+    int pending = 0;
+    for (int i = 0; i < n; ++i) {
+        slots[i].fd = -1;
+        slots[i].done = true;
+        servers[i].attempts++;
+        servers[i].last_rtt_ms = -1;
+        if (have[i] && open_and_send(&addr[i], &slots[i]) >= 0) {
+            slots[i].done = false;
+            pending++;
+        } else {
+            servers[i].addr = 0;
+        }
+    }
+
+    bool found = false, timed_out = false;
+    while (pending > 0) {
+        int64_t left = deadline - wall_us();
+        if (left <= 0) { timed_out = true; break; }
+
+        fd_set rd;
+        FD_ZERO(&rd);
+        int maxfd = -1;
+        for (int i = 0; i < n; ++i) {
+            if (slots[i].done) continue;
+            FD_SET(slots[i].fd, &rd);
+            if (slots[i].fd > maxfd) maxfd = slots[i].fd;
+        }
+        struct timeval tv = { .tv_sec = left / 1000000LL, .tv_usec = left % 1000000LL };
+        if (select(maxfd + 1, &rd, NULL, NULL, &tv) <= 0) { timed_out = true; break; }
+
+        for (int i = 0; i < n; ++i) {
+            if (slots[i].done || !FD_ISSET(slots[i].fd, &rd)) continue;
+            int64_t off, rtt;
+            if (!read_reply(&slots[i], &off, &rtt)) continue;   // keep waiting
+            slots[i].done = true;
+            pending--;
+            servers[i].successes++;
+            servers[i].last_rtt_ms = (int32_t)(rtt / 1000);
+            servers[i].last_offset_ms = (int32_t)(off / 1000);
+            if (!found || rtt < res->rtt_us) {
+                res->server = i;
+                res->offset_us = off;
+                res->rtt_us = rtt;
+                found = true;
+            }
+        }
+        if (found && mode == NTP_RACE_FIRST) break;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (slots[i].fd >= 0) close(slots[i].fd);
+        // silent for the whole timeout: the name may point elsewhere now
+        if (timed_out && !slots[i].done) servers[i].addr = 0;
+    }
+    return found;
+}
+
+#ifdef NTP_RACE_CHECK_MAIN
+/* cc -DNTP_RACE_CHECK_MAIN -Imain main/ntp_race.c -o ntp_check && ./ntp_check
+ * Races local stand-in servers on 127.0.0.1 run by a child process: a
+ * fast and a slow one with a known offset, one that never answers and
+ * one that answers somebody else's request. */
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define FAKE_OFFSET_US 2500000LL
+
+typedef struct {
+    int fd;
+    int delay_ms;          // -1 never answers
+    bool wrong_origin;
+    uint16_t port;
+} fake_t;
+
+typedef struct {
+    int64_t due;
+    int via;               // index into the fakes
+    struct sockaddr_in to;
+    uint8_t pkt[NTP_PACKET_LEN];
+} pend_t;
+
+static void fake_serve(fake_t *f, int nf)
+{
+    pend_t q[32];
+    int nq = 0;
+    for (;;) {
+        fd_set rd;
+        FD_ZERO(&rd);
+        int maxfd = -1;
+        for (int i = 0; i < nf; ++i) {
+            FD_SET(f[i].fd, &rd);
+            if (f[i].fd > maxfd) maxfd = f[i].fd;
+        }
+        int64_t now = wall_us(), wait = 100000;
+        for (int j = 0; j < nq; ++j) if (q[j].due - now < wait) wait = q[j].due - now;
+        struct timeval tv = { .tv_sec = 0, .tv_usec = wait > 0 ? wait : 0 };
+        select(maxfd + 1, &rd, NULL, NULL, &tv);
+
+        for (int i = 0; i < nf; ++i) {
+            if (!FD_ISSET(f[i].fd, &rd)) continue;
+            uint8_t in[NTP_PACKET_LEN];
+            struct sockaddr_in from;
+            socklen_t fl = sizeof(from);
+            if (recvfrom(f[i].fd, in, sizeof(in), 0, (struct sockaddr *)&from, &fl) != NTP_PACKET_LEN) continue;
+            if (f[i].delay_ms < 0 || nq == 32) continue;
+            pend_t *p = &q[nq++];
+            memset(p->pkt, 0, sizeof(p->pkt));
+            p->pkt[0] = 0x24;                    // LI 0, VN 4, mode 4 (server)
+            p->pkt[1] = 2;
+            put_ts(&p->pkt[24], f[i].wrong_origin ? get_ts(&in[40]) + 1 : get_ts(&in[40]));
+            p->due = wall_us() + f[i].delay_ms * 1000LL;
+            p->via = i;
+            p->to = from;
+        }
+
+        now = wall_us();
+        for (int j = 0; j < nq; ) {
+            if (q[j].due > now) { ++j; continue; }
+            // stamped on the way out, so the delay shows up as path delay
+            put_ts(&q[j].pkt[32], us_to_ntp(now + FAKE_OFFSET_US));
+            put_ts(&q[j].pkt[40], us_to_ntp(now + FAKE_OFFSET_US));
+            sendto(f[q[j].via].fd, q[j].pkt, NTP_PACKET_LEN, 0, (struct sockaddr *)&q[j].to, sizeof(q[j].to));
+            q[j] = q[--nq];
+        }
+    }
+}
+
+static int s_bad;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) s_bad++;
+    printf("%-4s %s\n", ok ? "ok" : "FAIL", what);
+}
+
+int main(void)
+{
+    fake_t f[] = {
+        { .delay_ms = 40 },                          // slow
+        { .delay_ms = 5 },                           // fast
+        { .delay_ms = -1 },                          // silent
+        { .delay_ms = 0, .wrong_origin = true },     // replies to someone else
+    };
+    const int nf = sizeof(f) / sizeof(f[0]);
+    for (int i = 0; i < nf; ++i) {
+        struct sockaddr_in a = { .sin_family = AF_INET };
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t al = sizeof(a);
+        f[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (f[i].fd < 0 || bind(f[i].fd, (struct sockaddr *)&a, sizeof(a)) < 0
+            || getsockname(f[i].fd, (struct sockaddr *)&a, &al) < 0) { perror("bind"); return 2; }
+        f[i].port = ntohs(a.sin_port);
+    }
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return 2; }
+    if (pid == 0) fake_serve(f, nf);
+
+    ntp_server_t sv[] = {
+        { .host = "localhost", .port = f[0].port },
+        { .host = "127.0.0.1", .port = f[1].port },
+        { .host = "127.0.0.1", .port = f[2].port },
+        { .host = "127.0.0.1", .port = f[3].port },
+    };
+    ntp_race_result_t r;
+    char msg[96];
+
+    int64_t t0 = wall_us();
+    bool ok = ntp_race_query(sv, 4, NTP_RACE_BEST_RTT, 300, &r);
+    int64_t took = wall_us() - t0;
+    snprintf(msg, sizeof(msg), "best rtt: server %d, offset %lld ms, rtt %lld ms", r.server,
+             (long long)(r.offset_us / 1000), (long long)(r.rtt_us / 1000));
+    // half the path delay is on each leg, so the offset is off by no more than half the rtt
+    check(ok && r.server == 1 && r.rtt_us >= 5000 && r.rtt_us < 20000
+          && llabs(r.offset_us - FAKE_OFFSET_US) <= r.rtt_us / 2 + 1000, msg);
+    snprintf(msg, sizeof(msg), "waited out the silent server: %lld ms", (long long)(took / 1000));
+    check(took >= 300000 && took < 350000, msg);
+    check(sv[0].successes == 1 && sv[1].successes == 1 && !sv[2].successes && !sv[3].successes,
+          "only the slow and fast servers count as answered");
+    check(sv[0].addr == htonl(INADDR_LOOPBACK), "localhost resolved and cached");
+    check(!sv[2].addr && !sv[3].addr, "cache dropped for the servers that never answered properly");
+
+    t0 = wall_us();
+    ok = ntp_race_query(sv, 4, NTP_RACE_FIRST, 300, &r);
+    took = wall_us() - t0;
+    snprintf(msg, sizeof(msg), "first: server %d after %lld ms", r.server, (long long)(took / 1000));
+    check(ok && r.server == 1 && took < 30000, msg);
+
+    ntp_server_t mute[] = {
+        { .host = "127.0.0.1", .port = f[2].port },
+        { .host = NULL, .ip_fallback = "127.0.0.1", .port = f[3].port },
+    };
+    t0 = wall_us();
+    ok = ntp_race_query(mute, 2, NTP_RACE_FIRST, 200, &r);
+    took = wall_us() - t0;
+    snprintf(msg, sizeof(msg), "no valid reply: gave up after %lld ms", (long long)(took / 1000));
+    check(!ok && took >= 200000 && took < 250000, msg);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    printf("%s\n", s_bad ? "FAILED" : "all ok");
+    return s_bad ? 1 : 0;
+}
+#endif
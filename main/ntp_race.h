@@ -0,0 +1,49 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Minimal NTP client that queries every server at once over plain
+ * sockets. No ESP-IDF dependencies, so it also builds on Linux. */
+
+typedef enum {
+    NTP_RACE_FIRST = 0,   // take the first valid reply
+    NTP_RACE_BEST_RTT     // wait for all replies (or timeout), take lowest RTT
+} ntp_race_mode_t;
+
+typedef struct {
+    const char *host;
+    const char *ip_fallback;   // used when DNS fails, nullable
+    uint16_t port;             // 0 = 123
+
+    // resolved IPv4 (network order), reused by later queries; 0 = look up
+    // again. Cleared when the server stops answering.
+    uint32_t addr;
+
+    // stats, updated by ntp_race_query()
+    uint32_t attempts;
+    uint32_t successes;
+    int32_t  last_rtt_ms;      // -1 if the last attempt got no valid reply
+    int32_t  last_offset_ms;
+} ntp_server_t;
+
+typedef struct {
+    int     server;            // index of the winning server
+    int64_t offset_us;         // add to local clock to get server time
+    int64_t rtt_us;
+} ntp_race_result_t;
+
+/* timeout_ms bounds the whole call, DNS included. Every lookup happens
+ * before the first request goes out, so one slow name delays the race
+ * instead of skewing it; with cached addresses there are none. A lookup
+ * is only started while time is left, but one in progress cannot be cut
+ * short by the socket API, so that one may end past the deadline. */
+bool ntp_race_query(ntp_server_t *servers, int n, ntp_race_mode_t mode,
+                    int timeout_ms, ntp_race_result_t *res);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,151 @@
+#include "pattern.h"
+#include "app_state.h"
+#include "driver/rmt_tx.h"
+#include "esp_log.h"
+
+static const char *TAGP = "pattern";
+
+// XTAL / 200: the slowest tick the channel divider reaches, 5 us.
+// One RMT half-symbol then spans up to ~163 ms.
+#define PATTERN_RES_HZ       200000
+#define PATTERN_TICKS_PER_MS (PATTERN_RES_HZ / 1000)
+#define PATTERN_HALF_MAX     32767
+// a looping pattern must fit the channel's RMT memory block (minus the end marker)
+#define PATTERN_MEM_SYMBOLS  48
+#define PATTERN_MAX_SYMBOLS  (PATTERN_MEM_SYMBOLS - 1)
+
+static const uint16_t s_click_ms[]   = { 30 };
+static const uint16_t s_confirm_ms[] = { 1000 };
+static const uint16_t s_sos_ms[] = {
+    200,200, 200,200, 200,600,
+    600,200, 600,200, 600,600,
+    200,200, 200,200, 200,1000
+};
+
+const pattern_t PATTERN_CLICK   = { s_click_ms,   1, false };
+const pattern_t PATTERN_CONFIRM = { s_confirm_ms, 1, false };
+const pattern_t PATTERN_SOS     = { s_sos_ms, sizeof(s_sos_ms) / sizeof(s_sos_ms[0]), true };
+
+typedef struct {
+    gpio_num_t gpio;
+    int active_level;
+    rmt_channel_handle_t chan;
+    rmt_symbol_word_t sym[PATTERN_MAX_SYMBOLS];
+    volatile pattern_prio_t prio;
+} pattern_ch_t;
+
+static pattern_ch_t s_ch[PATTERN_OUT_COUNT] = {
+    [PATTERN_OUT_LED] = { .gpio = ALARM_LED_GPIO, .active_level = ALARM_LED_ACTIVE_LEVEL },
+};
+static rmt_encoder_handle_t s_copy_enc = NULL;
+
+/* Expand the ms table into RMT symbols: each step becomes one or more
+ * halves of at most PATTERN_HALF_MAX ticks, two halves per symbol.
+ * Returns the symbol count, or -1 if it does not fit. */
+static int pattern_encode(const pattern_t *p, int active_level, rmt_symbol_word_t *sym, int max)
+{
+    int halves = 0;
+    uint32_t last_level = 0, last_ticks = 0;
+
+    for (int i = 0; i < p->n; ++i) {
+        uint32_t level = (i & 1) ? !active_level : active_level;
+        uint32_t ticks = (uint32_t)p->ms[i] * PATTERN_TICKS_PER_MS;
+        while (ticks) {
+            uint32_t d = ticks > PATTERN_HALF_MAX ? PATTERN_HALF_MAX : ticks;
+            if (halves / 2 >= max) return -1;
+            rmt_symbol_word_t *s = &sym[halves / 2];
+            if (halves & 1) { s->level1 = level; s->duration1 = d; }
+            else            { s->level0 = level; s->duration0 = d; }
+            halves++;
+            ticks -= d;
+            last_level = level;
+            last_ticks = d;
+        }
+    }
+    if (!halves) return 0;
+
+    // a zero duration would end the transmission; split the last half instead
+    if (halves & 1) {
+        rmt_symbol_word_t *s = &sym[halves / 2];
+        s->duration0 = last_ticks - last_ticks / 2;
+        s->level1 = last_level;
+        s->duration1 = last_ticks / 2;
+        halves++;
+    }
+    return halves / 2;
+}
+
+static bool IRAM_ATTR on_trans_done(rmt_channel_handle_t chan, const rmt_tx_done_event_data_t *ed, void *arg)
+{
+    ((pattern_ch_t *)arg)->prio = PATTERN_PRIO_NONE;
+    return false;
+}
+
+esp_err_t pattern_init(void)
+{
+    rmt_copy_encoder_config_t ecfg = {0};
+    ESP_ERROR_CHECK(rmt_new_copy_encoder(&ecfg, &s_copy_enc));
+
+    for (int i = 0; i < PATTERN_OUT_COUNT; ++i) {
+        pattern_ch_t *c = &s_ch[i];
+        rmt_tx_channel_config_t cfg = {
+            .gpio_num = c->gpio,
+            .clk_src = RMT_CLK_SRC_XTAL,
+            .resolution_hz = PATTERN_RES_HZ,
+            .mem_block_symbols = PATTERN_MEM_SYMBOLS,
+            .trans_queue_depth = 2,
+        };
+        esp_err_t err = rmt_new_tx_channel(&cfg, &c->chan);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAGP, "RMT channel for GPIO %d failed: %s", c->gpio, esp_err_to_name(err));
+            return err;
+        }
+        rmt_tx_event_callbacks_t cbs = { .on_trans_done = on_trans_done };
+        ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(c->chan, &cbs, c));
+        ESP_ERROR_CHECK(rmt_enable(c->chan));
+    }
+    return ESP_OK;
+}
+
+/* Abort whatever the channel is sending; disabling flushes the queue. */
+static void channel_abort(pattern_ch_t *c)
+{
+    rmt_disable(c->chan);
+    rmt_enable(c->chan);
+    c->prio = PATTERN_PRIO_NONE;
+}
+
+esp_err_t pattern_play(pattern_out_t out, const pattern_t *p, pattern_prio_t prio)
+{
+    pattern_ch_t *c = &s_ch[out];
+    if (!c->chan) return ESP_ERR_INVALID_STATE;
+    if (c->prio > prio) return ESP_ERR_INVALID_STATE;
+    if (c->prio != PATTERN_PRIO_NONE) channel_abort(c);
+
+    int n = pattern_encode(p, c->active_level, c->sym, PATTERN_MAX_SYMBOLS);
+    if (n <= 0) {
+        ESP_LOGE(TAGP, "pattern does not fit %d symbols", PATTERN_MAX_SYMBOLS);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    rmt_transmit_config_t tcfg = {
+        .loop_count = p->loop ? -1 : 0,
+        .flags.eot_level = !c->active_level,
+    };
+    c->prio = prio;
+    esp_err_t err = rmt_transmit(c->chan, s_copy_enc, c->sym, n * sizeof(c->sym[0]), &tcfg);
+    if (err != ESP_OK) c->prio = PATTERN_PRIO_NONE;
+    return err;
+}
+
+void pattern_stop(pattern_out_t out, pattern_prio_t prio)
+{
+    pattern_ch_t *c = &s_ch[out];
+    if (!c->chan || c->prio == PATTERN_PRIO_NONE || c->prio > prio) return;
+    channel_abort(c);
+}
+
+pattern_prio_t pattern_active(pattern_out_t out)
+{
+    return s_ch[out].prio;
+}
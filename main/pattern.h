@@ -0,0 +1,53 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* On/off patterns played by the RMT peripheral, so edges are timed in
+ * hardware and the CPU sleeps during playback. The buzzer has its own
+ * tone engine (tone.h).
+ *
+ * A pattern is a table of durations in ms that alternate on, off, on, ...
+ * starting with "on". A looping pattern repeats until stopped or pre-empted. */
+
+typedef struct {
+    const uint16_t *ms;
+    uint8_t n;
+    bool loop;
+} pattern_t;
+
+typedef enum {
+    PATTERN_OUT_LED = 0,
+    PATTERN_OUT_COUNT
+} pattern_out_t;
+
+// higher pre-empts lower on the same output
+typedef enum {
+    PATTERN_PRIO_NONE = 0,
+    PATTERN_PRIO_CLICK,
+    PATTERN_PRIO_CONFIRM,
+    PATTERN_PRIO_RING
+} pattern_prio_t;
+
+extern const pattern_t PATTERN_CLICK;     // 30 ms
+extern const pattern_t PATTERN_CONFIRM;   // 1 s
+extern const pattern_t PATTERN_SOS;       // ... --- ... looped
+
+esp_err_t pattern_init(void);
+
+/* Start p on out unless a higher-priority pattern is still playing there
+ * (ESP_ERR_INVALID_STATE). Safe from one task at a time. */
+esp_err_t pattern_play(pattern_out_t out, const pattern_t *p, pattern_prio_t prio);
+
+// stop out if it plays at or below prio; the output goes idle
+void pattern_stop(pattern_out_t out, pattern_prio_t prio);
+
+pattern_prio_t pattern_active(pattern_out_t out);
+
+#ifdef __cplusplus
+}
+#endif
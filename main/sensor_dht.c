@@ -1,25 +1,223 @@
+#include <stdio.h>
 #include "app_state.h"
 #include "esp_log.h"
+#include "nvs.h"
 #include "dht.h"
+#include "sensor_dht.h"
+#include "sensor_drv.h"
+#include "sensor_i2c.h"
+#include "display.h"
+#include "history.h"
+#include "time_svc.h"
+#include "ble_alarm.h"
 
 static const char *TAGS = "dht";
 
-static void dht_task(void *pvParameters)
-{
-    while (1) {
-        float temperature, humidity;
-        if (dht_read_float_data(SENSOR_TYPE, DHT_GPIO_PIN, &humidity, &temperature) == ESP_OK) {
-            s_temperature = temperature;
-            s_humidity = humidity;
-            ESP_LOGI(TAGS, "Humidity: %.1f%% Temp: %.1fC", s_humidity * 35, s_temperature * 30);
-        } else {
-            ESP_LOGW(TAGS, "Could not read data from sensor");
-        }
-        vTaskDelay(pdMS_TO_TICKS(5000));
+#define SENSOR_NVS_NAMESPACE "sensor"
+#define SENSOR_NVS_KEY_CAL   "cal"
+
+static int s_idx = -1;                   // registry slot of the DHT
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static sp_cal_t s_cal[2];                // temperature, humidity
+
+#ifdef DHT2_GPIO_PIN
+#define DHT_PROBES 2
+#else
+#define DHT_PROBES 1
+#endif
+
+// every probe is read in one dht_rmt_start_all(); the first leads on the registry
+static sensor_dev_t s_probe[DHT_PROBES];
+static dht_rmt_group_handle_t s_group;
+
+bool sensor_dht_get(sp_stats_t *temp, sp_stats_t *hum)
+{
+    sensor_snapshot_t s = { 0 };
+    bool ok = sensor_reg_get(s_idx, &s);
+    if (temp) *temp = s.temp;
+    if (hum) *hum = s.hum;
+    return ok;
+}
+
+void sensor_dht_get_rate(sp_rate_t *out)
+{
+    sensor_snapshot_t s = { 0 };
+    sensor_reg_get(s_idx, &s);
+    *out = s.rate;
+}
+
+void sensor_dht_get_cal(sp_cal_t *temp, sp_cal_t *hum)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (temp) *temp = s_cal[0];
+    if (hum) *hum = s_cal[1];
+    portEXIT_CRITICAL(&s_lock);
+}
+
+esp_err_t sensor_dht_set_cal(const sp_cal_t *temp, const sp_cal_t *hum)
+{
+    sp_cal_t cal[2];
+    sensor_dht_get_cal(&cal[0], &cal[1]);
+    if (temp) cal[0] = *temp;
+    if (hum) cal[1] = *hum;
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(SENSOR_NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(h, SENSOR_NVS_KEY_CAL, cal, sizeof(cal));
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+    if (err != ESP_OK) return err;
+
+    portENTER_CRITICAL(&s_lock);
+    s_cal[0] = cal[0];
+    s_cal[1] = cal[1];
+    portEXIT_CRITICAL(&s_lock);
+    sensor_reg_set_cal(s_idx, &cal[0], &cal[1]);
+    return ESP_OK;
+}
+
+static void load_cal(void)
+{
+    s_cal[0] = SP_CAL_IDENTITY;
+    s_cal[1] = SP_CAL_IDENTITY;
+
+    sp_cal_t cal[2];
+    size_t len = sizeof(cal);
+    nvs_handle_t h;
+    if (nvs_open(SENSOR_NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+    if (nvs_get_blob(h, SENSOR_NVS_KEY_CAL, cal, &len) == ESP_OK && len == sizeof(cal)
+        && cal[0].gain_q16 > 0 && cal[1].gain_q16 > 0) {
+        s_cal[0] = cal[0];
+        s_cal[1] = cal[1];
+        ESP_LOGI(TAGS, "Calibration: T %+d/%d, RH %+d/%d (offset/gain Q16)",
+                 (int)cal[0].offset, (int)cal[0].gain_q16, (int)cal[1].offset, (int)cal[1].gain_q16);
     }
+    nvs_close(h);
+}
+
+// hundredths as "-12.34"
+static const char *fmt_c100(char *buf, int32_t v)
+{
+    uint32_t a = v < 0 ? -(uint32_t)v : (uint32_t)v;
+    snprintf(buf, 12, "%s%u.%02u", v < 0 ? "-" : "", (unsigned)(a / 100), (unsigned)(a % 100));
+    return buf;
 }
 
+/* ---- DHT on the registry: the group completion completes every probe ---- */
+
+static bool dht_done(const dht_rmt_result_t *res, size_t n, void *arg)
+{
+    bool woken = false;
+    for (size_t i = 0; i < n; ++i) {
+        // the driver reports tenths
+        sensor_reading_t r = { .temp_c100 = res[i].temperature * 10, .hum_c100 = res[i].humidity * 10,
+                               .has = SENSOR_HAS_TEMP | SENSOR_HAS_HUM };
+        woken |= sensor_complete(&s_probe[i], res[i].res, &r);
+    }
+    return woken;
+}
+
+static esp_err_t dht_start(sensor_dev_t *dev)
+{
+    return dht_rmt_start_all(s_group, dht_done, NULL);
+}
+
+static const sensor_ops_t DHT_OPS = {
+    .start = dht_start,
+    .min_period_ms = 2000,       // DHT22 minimum, fine for the DHT11 too
+    .timeout_ms = 100,           // 25 ms read, the driver's own timeout reports first
+};
+
+static void on_dht(int idx, esp_err_t res, void *arg)
+{
+    static uint32_t last_period;
+    sensor_snapshot_t s;
+    sensor_reg_get(idx, &s);
+    ble_alarm_adv_refresh();
+    if (res != ESP_OK) {
+        ESP_LOGW(TAGS, "Could not read data from sensor: %s (%u in a row, %u/%u total), retry in %u ms",
+                 esp_err_to_name(res), s.rate.fail_streak, (unsigned)s.rate.failures,
+                 (unsigned)s.rate.reads, (unsigned)s.rate.period_ms);
+        last_period = s.rate.period_ms;
+        return;
+    }
+
+    if (s_mode == MODE_DHT) display_request_refresh();
+    // the log is indexed by wall time; a restored clock may be off until NTP confirms it
+    if (time_svc_is_verified())
+        hist_add((uint32_t)(time_svc_now_ms() / 1000), s.temp.last / 10, s.hum.last / 10);
+
+    char b1[12], b2[12], b3[12], b4[12];
+    ESP_LOGI(TAGS, "Humidity: %s%% Temp: %sC (avg %sC, trend %s/min)",
+             fmt_c100(b1, s.hum.last), fmt_c100(b2, s.temp.last), fmt_c100(b3, s.temp.filtered),
+             s.temp.trend_valid ? fmt_c100(b4, s.temp.trend_per_min) : "-");
+    if (s.rate.period_ms != last_period) ESP_LOGI(TAGS, "Sampling every %u ms", (unsigned)s.rate.period_ms);
+    last_period = s.rate.period_ms;
+}
+
+#if defined(SENSOR_I2C_SDA) || defined(DHT2_GPIO_PIN)
+static void on_extra(int idx, esp_err_t res, void *arg)
+{
+    sensor_snapshot_t s;
+    sensor_reg_get(idx, &s);
+    if (res != ESP_OK) {
+        ESP_LOGW(TAGS, "%s: %s (%u in a row)", s.name, esp_err_to_name(res), s.rate.fail_streak);
+        return;
+    }
+    char b1[12], b2[12];
+    if (s.has & SENSOR_HAS_PRESS)
+        ESP_LOGI(TAGS, "%s: Humidity: %s%% Temp: %sC Pressure: %u Pa", s.name,
+                 fmt_c100(b1, s.hum.last), fmt_c100(b2, s.temp.last), (unsigned)s.press_pa);
+    else
+        ESP_LOGI(TAGS, "%s: Humidity: %s%% Temp: %sC", s.name, fmt_c100(b1, s.hum.last), fmt_c100(b2, s.temp.last));
+}
+#endif
+
+#ifdef SENSOR_I2C_SDA
+
+static void add_i2c_sensors(void)
+{
+    esp_err_t err = sensor_i2c_bus_init(0, SENSOR_I2C_SDA, SENSOR_I2C_SCL, 100000);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAGS, "I2C bus: %s", esp_err_to_name(err));
+        return;
+    }
+    sensor_dev_t *dev;
+#ifdef SENSOR_SHT3X_ADDR
+    if ((err = sensor_sht3x_new(SENSOR_SHT3X_ADDR, &dev)) == ESP_OK) sensor_reg_add(dev, on_extra, NULL);
+    else ESP_LOGW(TAGS, "No SHT3x at 0x%02x: %s", SENSOR_SHT3X_ADDR, esp_err_to_name(err));
+#endif
+#ifdef SENSOR_BME280_ADDR
+    if ((err = sensor_bme280_new(SENSOR_BME280_ADDR, &dev)) == ESP_OK) sensor_reg_add(dev, on_extra, NULL);
+    else ESP_LOGW(TAGS, "No BME280 at 0x%02x: %s", SENSOR_BME280_ADDR, esp_err_to_name(err));
+#endif
+}
+#endif
+
 void sensor_dht_start_task(void)
 {
-    xTaskCreate(dht_task, "dht_task", 2048, NULL, 5, NULL);
+    load_cal();
+    dht_rmt_handle_t rmt[DHT_PROBES];
+    size_t n = 0;
+    ESP_ERROR_CHECK(dht_rmt_new(SENSOR_TYPE, DHT_GPIO_PIN, &rmt[n++]));
+#ifdef DHT2_GPIO_PIN
+    // own RMT channel, started with the first probe so both sample the same moment
+    if (dht_rmt_new(SENSOR_TYPE, DHT2_GPIO_PIN, &rmt[n]) == ESP_OK) ++n;
+#endif
+    ESP_ERROR_CHECK(dht_rmt_group_new(rmt, n, &s_group));
+
+    s_probe[0] = (sensor_dev_t){ .ops = &DHT_OPS, .name = "dht", .reg_idx = -1 };
+    s_idx = sensor_reg_add(&s_probe[0], on_dht, NULL);
+    sensor_reg_set_cal(s_idx, &s_cal[0], &s_cal[1]);
+#ifdef DHT2_GPIO_PIN
+    if (n > 1) {
+        s_probe[1] = (sensor_dev_t){ .name = "dht2", .reg_idx = -1 };
+        sensor_reg_add_follower(&s_probe[1], s_idx, on_extra, NULL);
+    }
+#endif
+#ifdef SENSOR_I2C_SDA
+    add_i2c_sensors();
+#endif
+    ESP_ERROR_CHECK(sensor_reg_start());
 }
@@ -1,2 +1,16 @@
 #pragma once
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sensor_pipe.h"
+
 void sensor_dht_start_task(void);
+
+// latest calibrated statistics in hundredths; false until the first good read
+bool sensor_dht_get(sp_stats_t *temp, sp_stats_t *hum);
+
+// sampling period and read/failure counters
+void sensor_dht_get_rate(sp_rate_t *out);
+
+// stored in NVS and applied from the next sample
+esp_err_t sensor_dht_set_cal(const sp_cal_t *temp, const sp_cal_t *hum);
+void sensor_dht_get_cal(sp_cal_t *temp, sp_cal_t *hum);
@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sensor_drv.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAGR = "sensors";
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+#define REG_LOCK()    portENTER_CRITICAL(&s_lock)
+#define REG_UNLOCK()  portEXIT_CRITICAL(&s_lock)
+#define REG_LOGW(fmt, ...) ESP_LOGW(TAGR, fmt, ##__VA_ARGS__)
+#else
+#include <stdio.h>
+#define REG_LOCK()
+#define REG_UNLOCK()
+#define REG_LOGW(fmt, ...) printf("W sensors: " fmt "\n", ##__VA_ARGS__)
+#endif
+
+// a read "moves" when it differs from the previous one by a delta, or the window trend is steep
+#define RATE_DELTA_T  50         // 0.5 C
+#define RATE_DELTA_H  200        // 2 %RH
+#define RATE_TREND_T  10         // 0.1 C/min
+
+static const sp_rate_cfg_t RATE_CFG = {
+    .min_ms = 1000,              // raised to the driver's min_period_ms
+    .max_ms = 60000,
+    .fail_max_ms = 300000,
+    .settle = 4,
+};
+
+typedef struct {
+    sensor_dev_t *dev;
+    sensor_listener_t cb;
+    void *arg;
+    sp_rate_cfg_t rate_cfg;
+    sp_series_t temp, hum;       // registry task only
+    int64_t due_us;              // next start, or the deadline while busy
+    volatile bool busy;
+    int8_t leader;               // -1, or the slot whose start() reads this one
+} slot_t;
+
+typedef struct {
+    int8_t idx;
+    esp_err_t res;
+    sensor_reading_t r;
+} done_msg_t;
+
+static slot_t s_slots[SENSOR_REG_MAX];
+static sensor_snapshot_t s_snap[SENSOR_REG_MAX];
+static sp_cal_t s_cal[SENSOR_REG_MAX][2];
+static int s_count = 0;
+static bool s_running = false;
+
+static int slot_add(sensor_dev_t *dev, int leader, sensor_listener_t cb, void *arg)
+{
+    slot_t *s = &s_slots[s_count];
+    memset(s, 0, sizeof(*s));
+    s->dev = dev;
+    s->cb = cb;
+    s->arg = arg;
+    s->leader = (int8_t)leader;
+    s->rate_cfg = RATE_CFG;
+    if (leader >= 0) s->rate_cfg = s_slots[leader].rate_cfg;
+    else if (dev->ops->min_period_ms > s->rate_cfg.min_ms) s->rate_cfg.min_ms = dev->ops->min_period_ms;
+    sp_series_init(&s->temp);
+    sp_series_init(&s->hum);
+
+    sensor_snapshot_t *snap = &s_snap[s_count];
+    memset(snap, 0, sizeof(*snap));
+    snap->name = dev->name;
+    sp_rate_init(&snap->rate, &s->rate_cfg);
+    s_cal[s_count][0] = SP_CAL_IDENTITY;
+    s_cal[s_count][1] = SP_CAL_IDENTITY;
+    dev->reg_idx = (int8_t)s_count;
+    return s_count++;
+}
+
+int sensor_reg_add(sensor_dev_t *dev, sensor_listener_t cb, void *arg)
+{
+    if (s_running || s_count >= SENSOR_REG_MAX || !dev || !dev->ops || !dev->ops->start) return -1;
+    return slot_add(dev, -1, cb, arg);
+}
+
+int sensor_reg_add_follower(sensor_dev_t *dev, int leader, sensor_listener_t cb, void *arg)
+{
+    if (s_running || s_count >= SENSOR_REG_MAX || !dev) return -1;
+    if (leader < 0 || leader >= s_count || s_slots[leader].leader >= 0) return -1;
+    return slot_add(dev, leader, cb, arg);
+}
+
+int sensor_reg_count(void)
+{
+    return s_count;
+}
+
+void sensor_reg_set_cal(int idx, const sp_cal_t *temp, const sp_cal_t *hum)
+{
+    if (idx < 0 || idx >= SENSOR_REG_MAX) return;
+    REG_LOCK();
+    if (temp) s_cal[idx][0] = *temp;
+    if (hum) s_cal[idx][1] = *hum;
+    REG_UNLOCK();
+}
+
+bool sensor_reg_get(int idx, sensor_snapshot_t *out)
+{
+    if (idx < 0 || idx >= s_count) return false;
+    REG_LOCK();
+    *out = s_snap[idx];
+    REG_UNLOCK();
+    return out->valid;
+}
+
+/* ---- scheduling core: no RTOS, time passed in ---- */
+
+static void handle_done(int idx, esp_err_t res, const sensor_reading_t *r, int64_t now_us)
+{
+    slot_t *s = &s_slots[idx];
+    sensor_snapshot_t snap;
+    sp_cal_t cal[2];
+    REG_LOCK();
+    snap = s_snap[idx];
+    cal[0] = s_cal[idx][0];
+    cal[1] = s_cal[idx][1];
+    REG_UNLOCK();
+
+    if (res == ESP_OK && !(r->has & (SENSOR_HAS_TEMP | SENSOR_HAS_HUM | SENSOR_HAS_PRESS)))
+        res = ESP_ERR_INVALID_RESPONSE;
+    if (res == ESP_OK) {
+        int64_t now_ms = now_us / 1000;
+        sp_stats_t st = snap.temp, sh = snap.hum;
+        if (r->has & SENSOR_HAS_TEMP) {
+            sp_series_push(&s->temp, sp_apply_cal(r->temp_c100, &cal[0]), now_ms);
+            sp_series_stats(&s->temp, &st);
+        }
+        if (r->has & SENSOR_HAS_HUM) {
+            sp_series_push(&s->hum, sp_apply_cal(r->hum_c100, &cal[1]), now_ms);
+            sp_series_stats(&s->hum, &sh);
+        }
+        bool moved = !snap.valid
+            || abs(st.last - snap.temp.last) >= RATE_DELTA_T
+            || abs(sh.last - snap.hum.last) >= RATE_DELTA_H
+            || (st.trend_valid && abs(st.trend_per_min) >= RATE_TREND_T);
+        sp_rate_ok(&snap.rate, &s->rate_cfg, moved);
+        snap.temp = st;
+        snap.hum = sh;
+        if (r->has & SENSOR_HAS_PRESS) snap.press_pa = r->press_pa;
+        snap.has |= r->has;
+        snap.valid = true;
+    } else {
+        sp_rate_fail(&snap.rate, &s->rate_cfg);
+    }
+
+    REG_LOCK();
+    s_snap[idx] = snap;
+    REG_UNLOCK();
+    s->due_us = now_us + (int64_t)snap.rate.period_ms * 1000;
+    s->busy = false;
+    if (s->cb) s->cb(idx, res, s->arg);
+}
+
+// the leader and its followers go busy together, before start() can complete any of them
+static void start_batch(int lead, int64_t now_us)
+{
+    slot_t *s = &s_slots[lead];
+    int64_t deadline = now_us + (int64_t)s->dev->ops->timeout_ms * 1000;
+    for (int i = lead; i < s_count; ++i) {
+        if (i != lead && s_slots[i].leader != lead) continue;
+        s_slots[i].due_us = deadline;
+        s_slots[i].busy = true;
+    }
+    esp_err_t err = s->dev->ops->start(s->dev);
+    if (err == ESP_OK) return;
+    for (int i = lead; i < s_count; ++i)
+        if ((i == lead || s_slots[i].leader == lead) && s_slots[i].busy) handle_done(i, err, NULL, now_us);
+}
+
+// fail what has overrun and start what is due; returns when to look again
+static int64_t reg_poll(int64_t now_us)
+{
+    int64_t next = now_us + 60000000LL;
+    for (int i = 0; i < s_count; ++i) {
+        slot_t *s = &s_slots[i];
+        if (s->busy && now_us >= s->due_us) {
+            const slot_t *l = s->leader >= 0 ? &s_slots[s->leader] : s;
+            REG_LOGW("%s: no completion in %u ms", s->dev->name, (unsigned)l->dev->ops->timeout_ms);
+            handle_done(i, ESP_ERR_TIMEOUT, NULL, now_us);
+        }
+        if (s->leader >= 0) {
+            // started with its leader; idle, it has nothing to wake for
+            if (s->busy && s->due_us < next) next = s->due_us;
+            continue;
+        }
+        if (!s->busy && now_us >= s->due_us) start_batch(i, now_us);
+        if (s->due_us < next) next = s->due_us;
+    }
+    return next;
+}
+
+static void reg_deliver(const done_msg_t *m, int64_t now_us)
+{
+    // not busy: the read already timed out
+    if (m->idx >= 0 && m->idx < s_count && s_slots[m->idx].busy)
+        handle_done(m->idx, m->res, &m->r, now_us);
+}
+
+#ifdef ESP_PLATFORM
+
+/* ---- target: completions through a queue to the registry task ---- */
+
+static QueueHandle_t s_done_q = NULL;
+
+bool sensor_complete(sensor_dev_t *dev, esp_err_t res, const sensor_reading_t *r)
+{
+    done_msg_t m = { .idx = dev->reg_idx, .res = res };
+    if (r) m.r = *r;
+    if (xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        xQueueSendFromISR(s_done_q, &m, &woken);
+        return woken == pdTRUE;
+    }
+    xQueueSend(s_done_q, &m, 0);
+    return false;
+}
+
+static void registry_task(void *pv)
+{
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        int64_t next = reg_poll(now);
+        TickType_t wait = next > now ? pdMS_TO_TICKS((next - now + 999) / 1000) : 0;
+        done_msg_t m;
+        while (xQueueReceive(s_done_q, &m, wait) == pdTRUE) {
+            reg_deliver(&m, esp_timer_get_time());
+            wait = 0;
+        }
+    }
+}
+
+esp_err_t sensor_reg_start(void)
+{
+    if (s_running) return ESP_ERR_INVALID_STATE;
+    s_done_q = xQueueCreate(2 * SENSOR_REG_MAX, sizeof(done_msg_t));
+    if (!s_done_q) return ESP_ERR_NO_MEM;
+    s_running = true;
+    for (int i = 0; i < s_count; ++i) {
+        const slot_t *s = &s_slots[i];
+        if (s->leader >= 0)
+            ESP_LOGI(TAGR, "%d: %s, read with %s", i, s->dev->name, s_slots[s->leader].dev->name);
+        else
+            ESP_LOGI(TAGR, "%d: %s, every %u..%u ms", i, s->dev->name,
+                     (unsigned)s->rate_cfg.min_ms, (unsigned)s->rate_cfg.max_ms);
+    }
+    return xTaskCreate(registry_task, "sensors", 4096, NULL, 5, NULL) == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+#else
+
+/* ---- host: a FIFO and a simulated clock ---- */
+
+#define HOST_Q_LEN (2 * SENSOR_REG_MAX)
+static done_msg_t s_host_q[HOST_Q_LEN];
+static unsigned s_host_head, s_host_len;
+static int64_t s_host_now;
+
+bool sensor_complete(sensor_dev_t *dev, esp_err_t res, const sensor_reading_t *r)
+{
+    if (s_host_len == HOST_Q_LEN) return false;   // dropped, as a full queue would
+    done_msg_t *m = &s_host_q[(s_host_head + s_host_len++) % HOST_Q_LEN];
+    *m = (done_msg_t){ .idx = dev->reg_idx, .res = res };
+    if (r) m->r = *r;
+    return false;
+}
+
+int64_t sensor_reg_now_us(void)
+{
+    return s_host_now;
+}
+
+void sensor_reg_run(int64_t until_us)
+{
+    s_running = true;
+    while (s_host_now <= until_us) {
+        int64_t next = reg_poll(s_host_now);
+        while (s_host_len) {
+            done_msg_t m = s_host_q[s_host_head];
+            s_host_head = (s_host_head + 1) % HOST_Q_LEN;
+            s_host_len--;
+            reg_deliver(&m, s_host_now);
+        }
+        // a delivery may have moved a deadline; poll again before sleeping
+        int64_t again = reg_poll(s_host_now);
+        if (s_host_len) continue;
+        if (again < next) next = again;
+        if (next <= s_host_now) next = s_host_now + 1;
+        if (next > until_us) break;
+        s_host_now = next;
+    }
+}
+
+#ifdef SENSOR_REG_CHECK_MAIN
+/* cc -DSENSOR_REG_CHECK_MAIN -Imain main/sensor_drv.c main/sensor_mock.c main/sensor_pipe.c \
+ *    -o sensor_check && ./sensor_check
+ * Drives the registry with scripted sensors through good reads, driver
+ * errors and missing completions, and checks each snapshot and the
+ * resulting rate; then a leader/follower pair read as one batch. */
+#include "sensor_mock.h"
+
+#define OK_T(t, h)  { ESP_OK, { (t), (h), 0, SENSOR_HAS_TEMP | SENSOR_HAS_HUM }, false }
+#define ERR(e)      { (e), { 0 }, false }
+#define NO_REPLY    { ESP_OK, { 0 }, true }
+#define ANY_PERIOD  0
+
+typedef struct {
+    int64_t t_us;
+    esp_err_t res;
+    sensor_snapshot_t snap;
+} seen_t;
+
+static seen_t s_seen[SENSOR_REG_MAX][64];
+static int s_nseen[SENSOR_REG_MAX];
+
+static void listener(int idx, esp_err_t res, void *arg)
+{
+    (void)arg;
+    if (s_nseen[idx] >= 64) return;
+    seen_t *e = &s_seen[idx][s_nseen[idx]++];
+    e->t_us = sensor_reg_now_us();
+    e->res = res;
+    sensor_reg_get(idx, &e->snap);
+}
+
+static int s_bad;
+
+static void expect(int idx, int i, esp_err_t res, int32_t temp, uint32_t period_ms, uint32_t failures, uint16_t streak)
+{
+    const seen_t *e = &s_seen[idx][i];
+    bool ok = i < s_nseen[idx] && e->res == res
+           && (period_ms == ANY_PERIOD || e->snap.rate.period_ms == period_ms)
+           && e->snap.rate.failures == failures && e->snap.rate.fail_streak == streak
+           && e->snap.valid && e->snap.temp.last == temp;
+    if (!ok) s_bad++;
+    printf("%-4s %s read %2d at %7lld ms: res 0x%x T %d period %u fails %u streak %u\n", ok ? "ok" : "FAIL",
+           e->snap.name ? e->snap.name : "?", i, (long long)(e->t_us / 1000), e->res, (int)e->snap.temp.last,
+           (unsigned)e->snap.rate.period_ms, (unsigned)e->snap.rate.failures, e->snap.rate.fail_streak);
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) s_bad++;
+    printf("%-4s %s\n", ok ? "ok" : "FAIL", what);
+}
+
+int main(void)
+{
+    static const sensor_mock_step_t script[] = {
+        OK_T(2300, 5000),              // 0: first read, fast
+        ERR(ESP_ERR_INVALID_CRC),      // 1: back off
+        NO_REPLY,                      // 2: registry timeout, back off further
+        OK_T(2300, 5000),              // 3: recovered, fast again
+        OK_T(2300, 5000), OK_T(2300, 5000), OK_T(2300, 5000), OK_T(2300, 5000),  // 4-7: quiet, slows after 4
+        OK_T(2900, 5000),              // 8: a 0.6 C step, fast again
+    };
+    static const sensor_mock_step_t other[] = { ERR(ESP_ERR_TIMEOUT) };
+    // a batch: each sensor has its own outcome, a missing reply fails both at one deadline
+    static const sensor_mock_step_t pair_a[] = { OK_T(2000, 4000), OK_T(2000, 4000), NO_REPLY, OK_T(2000, 4000) };
+    static const sensor_mock_step_t pair_b[] = { OK_T(1500, 6000), ERR(ESP_ERR_INVALID_CRC), NO_REPLY, OK_T(1500, 6000) };
+    sensor_mock_t m, m2, a, b;
+    sensor_mock_init(&m, "mock", script, sizeof(script) / sizeof(script[0]));
+    sensor_mock_init(&m2, "mock2", other, 1);
+    sensor_mock_init(&a, "pair.a", pair_a, 4);
+    sensor_mock_init(&b, "pair.b", pair_b, 4);
+    a.with = &b;
+    b.dev.ops = NULL;                      // a follower is never started itself
+    sensor_reg_add(&m.dev, listener, NULL);
+    sensor_reg_add(&m2.dev, NULL, NULL);   // a second sensor failing alongside must not disturb the first
+    int ia = sensor_reg_add(&a.dev, listener, NULL);
+    int ib = sensor_reg_add_follower(&b.dev, ia, listener, NULL);
+    check(sensor_reg_add_follower(&m2.dev, ib, NULL, NULL) < 0, "a follower cannot lead");
+    sp_cal_t cal = { 100, SP_GAIN_ONE };
+    sensor_reg_set_cal(0, &cal, NULL);
+
+    sensor_reg_run(30000000);
+
+    expect(0, 0, ESP_OK, 2400, 1000, 0, 0);
+    expect(0, 1, ESP_ERR_INVALID_CRC, 2400, 2000, 1, 1);
+    expect(0, 2, ESP_ERR_TIMEOUT, 2400, 4000, 2, 2);
+    expect(0, 3, ESP_OK, 2400, 1000, 2, 0);
+    // the step in read 0 .. 3 leaves no trend, so the quiet reads settle
+    expect(0, 4, ESP_OK, 2400, 1000, 2, 0);
+    expect(0, 5, ESP_OK, 2400, 1000, 2, 0);
+    expect(0, 6, ESP_OK, 2400, 1000, 2, 0);
+    expect(0, 7, ESP_OK, 2400, 2000, 2, 0);
+    expect(0, 8, ESP_OK, 3000, 1000, 2, 0);
+    // the timeout fired timeout_ms after its start, not a full period later
+    check(s_seen[0][2].t_us - s_seen[0][1].t_us == 2000000 + 50000, "timeout after timeout_ms");
+
+    sensor_snapshot_t s2;
+    sensor_reg_get(1, &s2);
+    check(!s2.valid && s2.rate.fail_streak == s2.rate.failures && s2.rate.failures > 0, "mock2 only fails");
+
+    // the follower's failures neither slow nor fail the leader
+    expect(ia, 0, ESP_OK, 2000, 1000, 0, 0);
+    expect(ia, 1, ESP_OK, 2000, 1000, 0, 0);
+    expect(ia, 2, ESP_ERR_TIMEOUT, 2000, 2000, 1, 1);
+    expect(ia, 3, ESP_OK, 2000, 1000, 1, 0);
+    expect(ib, 0, ESP_OK, 1500, ANY_PERIOD, 0, 0);
+    expect(ib, 1, ESP_ERR_INVALID_CRC, 1500, ANY_PERIOD, 1, 1);
+    expect(ib, 2, ESP_ERR_TIMEOUT, 1500, ANY_PERIOD, 2, 2);
+    expect(ib, 3, ESP_OK, 1500, ANY_PERIOD, 2, 0);
+    bool together = s_nseen[ia] == s_nseen[ib] && a.starts == b.starts;
+    for (int i = 0; together && i < s_nseen[ia]; ++i) together = s_seen[ia][i].t_us == s_seen[ib][i].t_us;
+    check(together, "the pair is always read and reported together");
+
+    printf("%s\n", s_bad ? "FAILED" : "all ok");
+    return s_bad ? 1 : 0;
+}
+#endif
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "sensor_pipe.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#else
+// host builds: the codes drivers and the registry use, same values as esp_err.h
+typedef int esp_err_t;
+#define ESP_OK                   0
+#define ESP_FAIL                 -1
+#define ESP_ERR_NO_MEM           0x101
+#define ESP_ERR_INVALID_ARG      0x102
+#define ESP_ERR_INVALID_STATE    0x103
+#define ESP_ERR_TIMEOUT          0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC      0x109
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sensor drivers and the registry that runs them.
+ *
+ * A driver only knows how to start a read. start() returns at once and
+ * the driver later reports the outcome with exactly one sensor_complete()
+ * call, from any task or ISR, possibly before start() has returned. The
+ * registry task schedules every sensor on its own adaptive period
+ * (sp_rate_t), applies calibration, keeps the rolling statistics and
+ * calls the sensor's listener. A read that never completes is failed
+ * after the driver's timeout_ms and a late completion is dropped.
+ *
+ * A follower has no schedule of its own: its leader's start() reads it
+ * in the same transaction (a batch) and the driver completes both. It
+ * shares the leader's deadline; its rate keeps its own read and failure
+ * counts, while the leader's period applies. */
+
+#define SENSOR_REG_MAX 4
+
+#define SENSOR_HAS_TEMP  0x01
+#define SENSOR_HAS_HUM   0x02
+#define SENSOR_HAS_PRESS 0x04
+
+typedef struct {
+    int32_t  temp_c100;      // 0.01 C
+    int32_t  hum_c100;       // 0.01 %RH
+    uint32_t press_pa;
+    uint8_t  has;            // SENSOR_HAS_* that are set
+} sensor_reading_t;
+
+typedef struct sensor_dev sensor_dev_t;
+
+typedef struct {
+    esp_err_t (*start)(sensor_dev_t *dev);
+    uint32_t min_period_ms;  // the part's fastest sampling
+    uint32_t timeout_ms;     // start to completion, worst case
+} sensor_ops_t;
+
+struct sensor_dev {
+    const sensor_ops_t *ops;
+    const char *name;
+    void *ctx;               // driver state
+    int8_t reg_idx;          // set by sensor_reg_add()
+};
+
+typedef struct {
+    const char *name;
+    sp_stats_t temp, hum;    // calibrated, hundredths
+    uint32_t   press_pa;     // last reading
+    uint8_t    has;          // fields seen so far
+    bool       valid;        // at least one good read
+    sp_rate_t  rate;
+} sensor_snapshot_t;
+
+// called from the registry task after every read, good or not
+typedef void (*sensor_listener_t)(int idx, esp_err_t res, void *arg);
+
+// before sensor_reg_start() / sensor_reg_run(); returns the index or -1
+int sensor_reg_add(sensor_dev_t *dev, sensor_listener_t cb, void *arg);
+// read whenever the sensor at index leader is; dev->ops may be NULL
+int sensor_reg_add_follower(sensor_dev_t *dev, int leader, sensor_listener_t cb, void *arg);
+int sensor_reg_count(void);
+#ifdef ESP_PLATFORM
+esp_err_t sensor_reg_start(void);
+#else
+/* Host: run the registry on a simulated clock, starting at 0, until
+ * until_us. Completions are delivered in order after each start. */
+void sensor_reg_run(int64_t until_us);
+int64_t sensor_reg_now_us(void);
+#endif
+
+void sensor_reg_set_cal(int idx, const sp_cal_t *temp, const sp_cal_t *hum);
+bool sensor_reg_get(int idx, sensor_snapshot_t *out);
+
+// driver side; returns true when a higher priority task was woken (ISR callers yield on it)
+bool sensor_complete(sensor_dev_t *dev, esp_err_t res, const sensor_reading_t *r);
+
+#ifdef __cplusplus
+}
+#endif
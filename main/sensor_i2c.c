@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/i2c.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sensor_i2c.h"
+
+static const char *TAGI = "sensor_i2c";
+
+#define BUS_TIMEOUT_MS 20
+
+static int s_port = -1;
+static QueueHandle_t s_txn_q = NULL;
+
+/* ---- bus task ---- */
+
+static void bus_task(void *pv)
+{
+    i2c_txn_t t;
+    while (1) {
+        if (xQueueReceive(s_txn_q, &t, portMAX_DELAY) != pdTRUE) continue;
+        esp_err_t err;
+        TickType_t to = pdMS_TO_TICKS(BUS_TIMEOUT_MS);
+        if (t.wr_len && t.rd_len)
+            err = i2c_master_write_read_device(s_port, t.addr, t.wr, t.wr_len, t.rd, t.rd_len, to);
+        else if (t.rd_len)
+            err = i2c_master_read_from_device(s_port, t.addr, t.rd, t.rd_len, to);
+        else
+            err = i2c_master_write_to_device(s_port, t.addr, t.wr, t.wr_len, to);
+        if (t.cb) t.cb(err, t.arg);
+    }
+}
+
+esp_err_t sensor_i2c_bus_init(int port, gpio_num_t sda, gpio_num_t scl, uint32_t hz)
+{
+    if (s_txn_q) return ESP_ERR_INVALID_STATE;
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = sda,
+        .scl_io_num = scl,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = hz,
+    };
+    esp_err_t err = i2c_param_config(port, &conf);
+    if (err == ESP_OK) err = i2c_driver_install(port, I2C_MODE_MASTER, 0, 0, 0);
+    if (err != ESP_OK) return err;
+    s_port = port;
+    s_txn_q = xQueueCreate(8, sizeof(i2c_txn_t));
+    if (!s_txn_q) return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAGI, "I2C%d on SDA %d / SCL %d at %u Hz", port, sda, scl, (unsigned)hz);
+    return xTaskCreate(bus_task, "i2c_bus", 2560, NULL, 6, NULL) == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t sensor_i2c_submit(const i2c_txn_t *t)
+{
+    if (!s_txn_q) return ESP_ERR_INVALID_STATE;
+    if (t->wr_len > I2C_TXN_WR_MAX || (!t->wr_len && !t->rd_len)) return ESP_ERR_INVALID_ARG;
+    return xQueueSend(s_txn_q, t, 0) == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+typedef struct {
+    SemaphoreHandle_t sem;
+    esp_err_t res;
+} sync_t;
+
+static void sync_done(esp_err_t res, void *arg)
+{
+    sync_t *w = arg;
+    w->res = res;
+    xSemaphoreGive(w->sem);
+}
+
+// setup only: queue a transfer and wait for it
+static esp_err_t xfer_sync(uint8_t addr, const uint8_t *wr, uint8_t wr_len, uint8_t *rd, uint8_t rd_len)
+{
+    sync_t w = { .sem = xSemaphoreCreateBinary(), .res = ESP_FAIL };
+    if (!w.sem) return ESP_ERR_NO_MEM;
+    i2c_txn_t t = { .addr = addr, .wr_len = wr_len, .rd_len = rd_len, .rd = rd, .cb = sync_done, .arg = &w };
+    memcpy(t.wr, wr, wr_len);
+    esp_err_t err = sensor_i2c_submit(&t);
+    if (err == ESP_OK) xSemaphoreTake(w.sem, portMAX_DELAY);
+    vSemaphoreDelete(w.sem);
+    return err == ESP_OK ? w.res : err;
+}
+
+/* ---- shared driver plumbing: command, conversion delay, read-out ---- */
+
+typedef struct i2c_sensor i2c_sensor_t;
+struct i2c_sensor {
+    sensor_dev_t dev;
+    uint8_t addr;
+    uint8_t cmd[I2C_TXN_WR_MAX], cmd_len;
+    uint8_t rd_reg[1], rd_reg_len;    // register to read the result from, if any
+    uint8_t buf[8], buf_len;
+    uint32_t conv_us;
+    esp_timer_handle_t timer;
+    esp_err_t (*decode)(i2c_sensor_t *s, sensor_reading_t *r);
+};
+
+static void readout_done(esp_err_t res, void *arg)
+{
+    i2c_sensor_t *s = arg;
+    sensor_reading_t r = { 0 };
+    if (res == ESP_OK) res = s->decode(s, &r);
+    sensor_complete(&s->dev, res, &r);
+}
+
+static void conv_timer_cb(void *arg)
+{
+    i2c_sensor_t *s = arg;
+    i2c_txn_t t = { .addr = s->addr, .wr_len = s->rd_reg_len, .rd_len = s->buf_len,
+                    .rd = s->buf, .cb = readout_done, .arg = s };
+    memcpy(t.wr, s->rd_reg, s->rd_reg_len);
+    esp_err_t err = sensor_i2c_submit(&t);
+    if (err != ESP_OK) sensor_complete(&s->dev, err, NULL);
+}
+
+static void cmd_done(esp_err_t res, void *arg)
+{
+    i2c_sensor_t *s = arg;
+    if (res == ESP_OK) res = esp_timer_start_once(s->timer, s->conv_us);
+    if (res != ESP_OK) sensor_complete(&s->dev, res, NULL);
+}
+
+static esp_err_t i2c_sensor_start(sensor_dev_t *dev)
+{
+    i2c_sensor_t *s = dev->ctx;
+    i2c_txn_t t = { .addr = s->addr, .wr_len = s->cmd_len, .cb = cmd_done, .arg = s };
+    memcpy(t.wr, s->cmd, s->cmd_len);
+    return sensor_i2c_submit(&t);
+}
+
+static i2c_sensor_t *i2c_sensor_alloc(const sensor_ops_t *ops, const char *name, uint8_t addr, size_t size)
+{
+    i2c_sensor_t *s = calloc(1, size);
+    if (!s) return NULL;
+    s->dev.ops = ops;
+    s->dev.name = name;
+    s->dev.ctx = s;
+    s->dev.reg_idx = -1;
+    s->addr = addr;
+    esp_timer_create_args_t ta = { .callback = conv_timer_cb, .arg = s, .name = name };
+    if (esp_timer_create(&ta, &s->timer) != ESP_OK) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void i2c_sensor_free(i2c_sensor_t *s)
+{
+    esp_timer_delete(s->timer);
+    free(s);
+}
+
+/* ---- SHT3x: single shot, high repeatability, no clock stretching ---- */
+
+static uint8_t crc8_sht(const uint8_t *p, int n)
+{
+    uint8_t crc = 0xFF;
+    while (n--) {
+        crc ^= *p++;
+        for (int b = 0; b < 8; ++b) crc = crc & 0x80 ? (uint8_t)(crc << 1) ^ 0x31 : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static esp_err_t sht3x_decode(i2c_sensor_t *s, sensor_reading_t *r)
+{
+    const uint8_t *b = s->buf;
+    if (crc8_sht(b, 2) != b[2] || crc8_sht(b + 3, 2) != b[5]) return ESP_ERR_INVALID_CRC;
+    uint32_t rt = (b[0] << 8) | b[1], rh = (b[3] << 8) | b[4];
+    r->temp_c100 = -4500 + (int32_t)((17500 * rt + 32767) / 65535);
+    r->hum_c100 = (int32_t)((10000 * rh + 32767) / 65535);
+    r->has = SENSOR_HAS_TEMP | SENSOR_HAS_HUM;
+    return ESP_OK;
+}
+
+static const sensor_ops_t SHT3X_OPS = {
+    .start = i2c_sensor_start,
+    .min_period_ms = 1000,
+    .timeout_ms = 100,
+};
+
+esp_err_t sensor_sht3x_new(uint8_t addr, sensor_dev_t **out)
+{
+    i2c_sensor_t *s = i2c_sensor_alloc(&SHT3X_OPS, "sht3x", addr, sizeof(*s));
+    if (!s) return ESP_ERR_NO_MEM;
+    // soft reset doubles as a presence check
+    static const uint8_t reset[] = { 0x30, 0xA2 };
+    esp_err_t err = xfer_sync(addr, reset, sizeof(reset), NULL, 0);
+    if (err != ESP_OK) {
+        i2c_sensor_free(s);
+        return err;
+    }
+    s->cmd[0] = 0x24; s->cmd[1] = 0x00; s->cmd_len = 2;
+    s->buf_len = 6;
+    s->conv_us = 16000;       // 15.5 ms max
+    s->decode = sht3x_decode;
+    *out = &s->dev;
+    return ESP_OK;
+}
+
+/* ---- BME280: forced mode, x1 oversampling, Bosch integer compensation ---- */
+
+typedef struct {
+    i2c_sensor_t base;
+    uint16_t T1; int16_t T2, T3;
+    uint16_t P1; int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+    uint8_t  H1, H3; int16_t H2, H4, H5; int8_t H6;
+} bme280_t;
+
+static esp_err_t bme280_decode(i2c_sensor_t *s, sensor_reading_t *r)
+{
+    const bme280_t *c = (const bme280_t *)s;
+    const uint8_t *b = s->buf;
+    int32_t adc_P = (b[0] << 12) | (b[1] << 4) | (b[2] >> 4);
+    int32_t adc_T = (b[3] << 12) | (b[4] << 4) | (b[5] >> 4);
+    int32_t adc_H = (b[6] << 8) | b[7];
+    if (adc_T == 0x80000) return ESP_ERR_INVALID_RESPONSE;   // measurement skipped
+
+    int32_t v1 = ((((adc_T >> 3) - ((int32_t)c->T1 << 1))) * c->T2) >> 11;
+    int32_t v2 = (((((adc_T >> 4) - (int32_t)c->T1) * ((adc_T >> 4) - (int32_t)c->T1)) >> 12) * c->T3) >> 14;
+    int32_t t_fine = v1 + v2;
+    r->temp_c100 = (t_fine * 5 + 128) >> 8;
+    r->has = SENSOR_HAS_TEMP;
+
+    int64_t p1 = (int64_t)t_fine - 128000;
+    int64_t p2 = p1 * p1 * c->P6;
+    p2 += (p1 * c->P5) << 17;
+    p2 += (int64_t)c->P4 << 35;
+    p1 = ((p1 * p1 * c->P3) >> 8) + ((p1 * c->P2) << 12);
+    p1 = ((((int64_t)1) << 47) + p1) * c->P1 >> 33;
+    if (p1 != 0 && adc_P != 0x80000) {
+        int64_t p = 1048576 - adc_P;
+        p = (((p << 31) - p2) * 3125) / p1;
+        p1 = ((int64_t)c->P9 * (p >> 13) * (p >> 13)) >> 25;
+        p2 = ((int64_t)c->P8 * p) >> 19;
+        p = ((p + p1 + p2) >> 8) + ((int64_t)c->P7 << 4);
+        r->press_pa = (uint32_t)((p + 128) >> 8);          // from Q24.8
+        r->has |= SENSOR_HAS_PRESS;
+    }
+
+    if (adc_H != 0x8000) {
+        int32_t h = t_fine - 76800;
+        h = (((((adc_H << 14) - ((int32_t)c->H4 << 20) - (c->H5 * h)) + 16384) >> 15)
+             * (((((((h * c->H6) >> 10) * (((h * (int32_t)c->H3) >> 11) + 32768)) >> 10) + 2097152)
+                 * c->H2 + 8192) >> 14));
+        h -= ((((h >> 15) * (h >> 15)) >> 7) * (int32_t)c->H1) >> 4;
+        if (h < 0) h = 0;
+        if (h > 419430400) h = 419430400;
+        r->hum_c100 = (int32_t)((((uint32_t)h >> 12) * 100 + 512) >> 10);   // from Q22.10
+        r->has |= SENSOR_HAS_HUM;
+    }
+    return ESP_OK;
+}
+
+static const sensor_ops_t BME280_OPS = {
+    .start = i2c_sensor_start,
+    .min_period_ms = 1000,
+    .timeout_ms = 100,
+};
+
+esp_err_t sensor_bme280_new(uint8_t addr, sensor_dev_t **out)
+{
+    bme280_t *c = (bme280_t *)i2c_sensor_alloc(&BME280_OPS, "bme280", addr, sizeof(bme280_t));
+    if (!c) return ESP_ERR_NO_MEM;
+
+    uint8_t reg = 0xD0, id = 0, t[26], h[7];
+    esp_err_t err = xfer_sync(addr, &reg, 1, &id, 1);
+    if (err == ESP_OK && id != 0x60) err = ESP_ERR_NOT_FOUND;
+    reg = 0x88;
+    if (err == ESP_OK) err = xfer_sync(addr, &reg, 1, t, sizeof(t));
+    reg = 0xE1;
+    if (err == ESP_OK) err = xfer_sync(addr, &reg, 1, h, sizeof(h));
+    if (err != ESP_OK) {
+        i2c_sensor_free(&c->base);
+        return err;
+    }
+#define LE16(p) ((uint16_t)((p)[0] | ((p)[1] << 8)))
+    c->T1 = LE16(t);          c->T2 = (int16_t)LE16(t + 2);  c->T3 = (int16_t)LE16(t + 4);
+    c->P1 = LE16(t + 6);      c->P2 = (int16_t)LE16(t + 8);  c->P3 = (int16_t)LE16(t + 10);
+    c->P4 = (int16_t)LE16(t + 12); c->P5 = (int16_t)LE16(t + 14); c->P6 = (int16_t)LE16(t + 16);
+    c->P7 = (int16_t)LE16(t + 18); c->P8 = (int16_t)LE16(t + 20); c->P9 = (int16_t)LE16(t + 22);
+    c->H1 = t[25];
+    c->H2 = (int16_t)LE16(h);
+    c->H3 = h[2];
+    c->H4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0F));
+    c->H5 = (int16_t)((int8_t)h[5] * 16 | (h[4] >> 4));
+    c->H6 = (int8_t)h[6];
+#undef LE16
+
+    i2c_sensor_t *s = &c->base;
+    // ctrl_hum only latches on the ctrl_meas write that follows it: x1 humidity, then x1 T/P + forced
+    s->cmd[0] = 0xF2; s->cmd[1] = 0x01; s->cmd[2] = 0xF4; s->cmd[3] = 0x25; s->cmd_len = 4;
+    s->rd_reg[0] = 0xF7; s->rd_reg_len = 1;
+    s->buf_len = 8;
+    s->conv_us = 10000;       // 9.3 ms max at x1
+    s->decode = bme280_decode;
+    *out = &s->dev;
+    return ESP_OK;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "sensor_drv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* I2C sensor backends. Transfers are queued to one bus task and finish
+ * through a callback, so a driver never waits on the bus or on the part:
+ * conversion delays are esp_timer one-shots that queue the read-out. */
+
+typedef void (*i2c_txn_cb_t)(esp_err_t res, void *arg);
+
+#define I2C_TXN_WR_MAX 4
+
+typedef struct {
+    uint8_t  addr;
+    uint8_t  wr_len, rd_len;
+    uint8_t  wr[I2C_TXN_WR_MAX];  // register address and/or data
+    uint8_t *rd;                  // caller's buffer, valid until cb runs
+    i2c_txn_cb_t cb;              // bus task context
+    void *arg;
+} i2c_txn_t;
+
+esp_err_t sensor_i2c_bus_init(int port, gpio_num_t sda, gpio_num_t scl, uint32_t hz);
+esp_err_t sensor_i2c_submit(const i2c_txn_t *t);
+
+// the sensor_dev_t is allocated and owned by the backend; fails if the part doesn't answer
+esp_err_t sensor_sht3x_new(uint8_t addr, sensor_dev_t **out);    // 0x44 or 0x45
+esp_err_t sensor_bme280_new(uint8_t addr, sensor_dev_t **out);   // 0x76 or 0x77
+
+#ifdef __cplusplus
+}
+#endif
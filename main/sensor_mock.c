@@ -0,0 +1,34 @@
+#include <string.h>
+#include "sensor_mock.h"
+
+static void mock_play(sensor_mock_t *m)
+{
+    const sensor_mock_step_t *s = &m->steps[m->starts++ % m->n_steps];
+    if (!s->timeout) sensor_complete(&m->dev, s->res, &s->r);
+}
+
+static esp_err_t mock_start(sensor_dev_t *dev)
+{
+    sensor_mock_t *m = dev->ctx;
+    if (!m->n_steps || (m->with && !m->with->n_steps)) return ESP_ERR_INVALID_STATE;
+    mock_play(m);
+    if (m->with) mock_play(m->with);
+    return ESP_OK;
+}
+
+static const sensor_ops_t MOCK_OPS = {
+    .start = mock_start,
+    .min_period_ms = 0,
+    .timeout_ms = 50,
+};
+
+void sensor_mock_init(sensor_mock_t *m, const char *name, const sensor_mock_step_t *steps, uint16_t n_steps)
+{
+    memset(m, 0, sizeof(*m));
+    m->dev.ops = &MOCK_OPS;
+    m->dev.name = name;
+    m->dev.ctx = m;
+    m->dev.reg_idx = -1;
+    m->steps = steps;
+    m->n_steps = n_steps;
+}
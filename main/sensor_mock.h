@@ -0,0 +1,33 @@
+#pragma once
+#include "sensor_drv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Scripted sensor for exercising the registry without hardware, on the
+ * target or on a host. Each start() plays the next step, wrapping at the
+ * end, and completes before returning. A step with timeout set never
+ * completes, so the registry's timeout path runs. A mock set as another's
+ * "with" plays its own next step in that mock's start(), after it, like
+ * the second sensor of a batch read. Plain C. */
+
+typedef struct {
+    esp_err_t res;
+    sensor_reading_t r;
+    bool timeout;
+} sensor_mock_step_t;
+
+typedef struct sensor_mock {
+    sensor_dev_t dev;
+    const sensor_mock_step_t *steps;
+    uint16_t n_steps;
+    uint32_t starts;          // steps played so far
+    struct sensor_mock *with; // read in the same start(), nullable
+} sensor_mock_t;
+
+void sensor_mock_init(sensor_mock_t *m, const char *name, const sensor_mock_step_t *steps, uint16_t n_steps);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,174 @@
+#include <string.h>
+#include "sensor_pipe.h"
+
+#define MASK (SP_WINDOW - 1)
+
+static void dq_push(sp_deque_t *d, uint32_t seq, int32_t v, bool keep_min)
+{
+    // drop entries the new sample makes irrelevant for the rest of their life
+    while (d->len) {
+        int32_t back = d->v[(d->head + d->len - 1) & MASK];
+        if (keep_min ? back < v : back > v) break;
+        d->len--;
+    }
+    uint8_t i = (d->head + d->len) & MASK;
+    d->seq[i] = seq;
+    d->v[i] = v;
+    d->len++;
+}
+
+static void dq_expire(sp_deque_t *d, uint32_t oldest_seq)
+{
+    while (d->len && (int32_t)(d->seq[d->head] - oldest_seq) < 0) {
+        d->head = (d->head + 1) & MASK;
+        d->len--;
+    }
+}
+
+void sp_series_init(sp_series_t *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void sp_series_push(sp_series_t *s, int32_t value, int64_t t_ms)
+{
+    uint32_t n = s->seq;
+    uint8_t i = n & MASK;
+
+    if (n >= SP_WINDOW) {   // slot i holds the sample leaving the window
+        s->sum_old -= s->v[i];
+        s->tsum_old -= s->t_ms[i];
+    }
+    if (n >= SP_HALF) {     // and this one moves from the newer half to the older
+        uint8_t j = (n - SP_HALF) & MASK;
+        s->sum_new -= s->v[j];  s->sum_old += s->v[j];
+        s->tsum_new -= s->t_ms[j]; s->tsum_old += s->t_ms[j];
+    }
+    s->v[i] = value;
+    s->t_ms[i] = t_ms;
+    s->sum_new += value;
+    s->tsum_new += t_ms;
+
+    // expire first: a monotonic run keeps every sample, so the deques are full here
+    if (n >= SP_WINDOW) {
+        dq_expire(&s->lo, n + 1 - SP_WINDOW);
+        dq_expire(&s->hi, n + 1 - SP_WINDOW);
+    }
+    dq_push(&s->lo, n, value, true);
+    dq_push(&s->hi, n, value, false);
+    s->seq = n + 1;
+}
+
+static int64_t div_round(int64_t a, int64_t b)
+{
+    return (a >= 0) == (b >= 0) ? (a + b / 2) / b : (a - b / 2) / b;
+}
+
+void sp_series_stats(const sp_series_t *s, sp_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s->seq) return;
+
+    int64_t n_new = s->seq < SP_HALF ? s->seq : SP_HALF;
+    int64_t n_old = s->seq <= SP_HALF ? 0 : (s->seq - SP_HALF < SP_HALF ? s->seq - SP_HALF : SP_HALF);
+
+    out->count = (uint16_t)(n_new + n_old);
+    out->last = s->v[(s->seq - 1) & MASK];
+    out->filtered = (int32_t)div_round(s->sum_new + s->sum_old, n_new + n_old);
+    out->min = s->lo.v[s->lo.head];
+    out->max = s->hi.v[s->hi.head];
+
+    if (!n_old) return;
+    // difference of the half means over the distance of their mean times,
+    // both scaled by n_new * n_old to stay in integers
+    int64_t dv = s->sum_new * n_old - s->sum_old * n_new;
+    int64_t dt = s->tsum_new * n_old - s->tsum_old * n_new;
+    if (dt <= 0) return;
+    out->trend_per_min = (int32_t)div_round(dv * 60000, dt);
+    out->trend_valid = true;
+}
+
+void sp_rate_init(sp_rate_t *r, const sp_rate_cfg_t *cfg)
+{
+    memset(r, 0, sizeof(*r));
+    r->period_ms = cfg->min_ms;
+}
+
+bool sp_rate_ok(sp_rate_t *r, const sp_rate_cfg_t *cfg, bool moved)
+{
+    uint32_t old = r->period_ms;
+    r->reads++;
+    if (moved || r->fail_streak) {
+        r->fail_streak = 0;
+        r->quiet = 0;
+        r->period_ms = cfg->min_ms;
+    } else if (++r->quiet >= cfg->settle) {
+        r->quiet = 0;
+        r->period_ms = r->period_ms > cfg->max_ms / 2 ? cfg->max_ms : r->period_ms * 2;
+    }
+    return r->period_ms != old;
+}
+
+bool sp_rate_fail(sp_rate_t *r, const sp_rate_cfg_t *cfg)
+{
+    uint32_t old = r->period_ms;
+    r->reads++;
+    r->failures++;
+    r->quiet = 0;
+    if (r->fail_streak < UINT16_MAX) r->fail_streak++;
+    uint64_t p = (uint64_t)cfg->min_ms << (r->fail_streak < 16 ? r->fail_streak : 16);
+    r->period_ms = p > cfg->fail_max_ms ? cfg->fail_max_ms : (uint32_t)p;
+    return r->period_ms != old;
+}
+
+#ifdef SENSOR_PIPE_CHECK_MAIN
+/* cc -DSENSOR_PIPE_CHECK_MAIN -Imain main/sensor_pipe.c -o sp_check && ./sp_check
+ * Window min/max/mean against brute force over rising, falling and noisy runs
+ * several windows long. */
+#include <stdio.h>
+#include <stdlib.h>
+
+static int check_run(const char *name, int32_t (*gen)(int))
+{
+    static sp_series_t s;
+    int32_t hist[4 * SP_WINDOW];
+    int bad = 0;
+    sp_series_init(&s);
+    for (int k = 0; k < 4 * SP_WINDOW; ++k) {
+        hist[k] = gen(k);
+        sp_series_push(&s, hist[k], 1000LL * k);
+        int first = k + 1 > SP_WINDOW ? k + 1 - SP_WINDOW : 0;
+        int64_t sum = 0;
+        int32_t mn = hist[first], mx = hist[first];
+        for (int j = first; j <= k; ++j) {
+            sum += hist[j];
+            if (hist[j] < mn) mn = hist[j];
+            if (hist[j] > mx) mx = hist[j];
+        }
+        sp_stats_t st;
+        sp_series_stats(&s, &st);
+        int n = k + 1 - first;
+        int32_t mean = (int32_t)(sum >= 0 ? (sum + n / 2) / n : (sum - n / 2) / n);
+        if (st.min != mn || st.max != mx || st.filtered != mean || st.count != n
+            || s.lo.len > SP_WINDOW || s.hi.len > SP_WINDOW) {
+            if (bad++ < 3)
+                printf("%s: sample %d: min %d/%d max %d/%d mean %d/%d len %u/%u\n", name, k,
+                       (int)st.min, (int)mn, (int)st.max, (int)mx, (int)st.filtered, (int)mean,
+                       s.lo.len, s.hi.len);
+        }
+    }
+    printf("%-8s %s\n", name, bad ? "FAIL" : "ok");
+    return bad;
+}
+
+static int32_t rising(int k)  { return 1000 + 10 * k; }
+static int32_t falling(int k) { return 1000 - 10 * k; }
+static int32_t noisy(int k)   { return 2000 + k + rand() % 200 - 100; }
+
+int main(void)
+{
+    srand(1);
+    int bad = check_run("rising", rising) + check_run("falling", falling) + check_run("noisy", noisy);
+    return bad ? 1 : 0;
+}
+#endif
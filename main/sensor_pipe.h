@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fixed-point sensor series: calibration, a ring of recent samples and
+ * rolling statistics, each updated in O(1) per sample with integer math
+ * only (the C3 has no FPU). Values are in hundredths (0.01 C, 0.01 %RH).
+ * Plain C; callers provide locking. */
+
+#define SP_WINDOW 32                 // samples kept, power of two
+#define SP_HALF   (SP_WINDOW / 2)    // trend compares the two halves
+
+#define SP_GAIN_ONE 65536            // gain is Q16
+typedef struct {
+    int32_t offset;                  // hundredths, added after the gain
+    int32_t gain_q16;
+} sp_cal_t;
+#define SP_CAL_IDENTITY ((sp_cal_t){ 0, SP_GAIN_ONE })
+
+typedef struct {
+    uint32_t seq[SP_WINDOW];
+    int32_t  v[SP_WINDOW];
+    uint8_t  head, len;
+} sp_deque_t;
+
+typedef struct {
+    int32_t  v[SP_WINDOW];
+    int64_t  t_ms[SP_WINDOW];
+    uint32_t seq;                    // samples pushed so far
+    int64_t  sum_new, sum_old;       // last SP_HALF samples, the SP_HALF before
+    int64_t  tsum_new, tsum_old;
+    sp_deque_t lo, hi;               // monotonic: front is the window min / max
+} sp_series_t;
+
+typedef struct {
+    int32_t  last;
+    int32_t  filtered;               // window mean
+    int32_t  min, max;               // over the window
+    int32_t  trend_per_min;          // hundredths per minute, newer half vs older half
+    uint16_t count;                  // samples in the window
+    bool     trend_valid;
+} sp_stats_t;
+
+// raw hundredths through gain and offset
+static inline int32_t sp_apply_cal(int32_t raw, const sp_cal_t *c)
+{
+    return (int32_t)(((int64_t)raw * c->gain_q16 + SP_GAIN_ONE / 2) >> 16) + c->offset;
+}
+
+void sp_series_init(sp_series_t *s);
+void sp_series_push(sp_series_t *s, int32_t value, int64_t t_ms);
+void sp_series_stats(const sp_series_t *s, sp_stats_t *out);
+
+/* Sampling period controller. A read that moved the signal drops the
+ * period to min_ms; every `settle` quiet reads in a row double it, up to
+ * max_ms. Failed reads back off exponentially from min_ms to fail_max_ms
+ * and the next good read starts over at min_ms. */
+typedef struct {
+    uint32_t min_ms, max_ms, fail_max_ms;
+    uint8_t  settle;
+} sp_rate_cfg_t;
+
+typedef struct {
+    uint32_t period_ms;              // delay before the next read
+    uint32_t reads, failures;        // totals
+    uint16_t fail_streak;            // consecutive failures
+    uint8_t  quiet;                  // quiet reads since the last change of period
+} sp_rate_t;
+
+void sp_rate_init(sp_rate_t *r, const sp_rate_cfg_t *cfg);
+// returns true when the period changed
+bool sp_rate_ok(sp_rate_t *r, const sp_rate_cfg_t *cfg, bool moved);
+bool sp_rate_fail(sp_rate_t *r, const sp_rate_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,12 +1,275 @@
 #include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
 #include "app_state.h"
+#include "time_svc.h"
+#include "ntp_race.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_rtc_time.h"
+#include "nvs.h"
+#include "display.h"
+#include "alarm_task.h"
+#include "ble_alarm.h"
 #include "lwip/apps/sntp.h"
 #include "lwip/ip_addr.h"
 
 static const char *TAGT = "time";
 
+#ifndef TIME_SVC_BENCH
+#define TIME_SVC_BENCH 0
+#endif
+
+// Re-anchor when the system clock and the monotonic estimate disagree by more
+#define TIME_STEP_THRESHOLD_US 500000LL
+
+static portMUX_TYPE s_tm_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#ifndef TIME_ERROR_BUDGET_MS
+#define TIME_ERROR_BUDGET_MS 100
+#endif
+#define NTP_INTERVAL_DEFAULT_S  3600
+#define NTP_INTERVAL_MIN_S      (15 * 60)
+#define NTP_INTERVAL_MAX_S      (24 * 3600)
+#define DRIFT_MIN_SPAN_US       (10LL * 60 * 1000000)  // shorter spans are mostly NTP noise
+#define DRIFT_RESIDUAL_FLOOR_PPB 500
+
+/* Wall clock anchored to esp_timer: epoch_us was the time at mono_us,
+ * and the oscillator runs drift_ppb fast. Published with g_tm under g_tm_seq. */
+typedef struct {
+    int64_t epoch_us;
+    int64_t mono_us;
+    int32_t drift_ppb;
+} time_anchor_t;
+
+static time_anchor_t s_anchor = {0};
+static time_t  s_snap_epoch = 0;      // epoch second that g_tm describes
+
+// ntp_task private: drift estimation and sync scheduling
+static volatile int32_t s_drift_ppb = 0;       // applied at the next re-anchor
+static volatile bool    s_reanchor_req = false;
+static bool     s_drift_valid = false;
+static int64_t  s_last_sync_mono_us = -1;
+static uint32_t s_ntp_interval_s = NTP_INTERVAL_DEFAULT_S;
+static uint32_t s_error_budget_ms = TIME_ERROR_BUDGET_MS;
+
+// time_task private: cached local time, advanced one second at a time
+static struct tm s_cached;
+static time_t    s_cached_epoch = 0;
+static uint32_t  s_full_conversions = 0;
+
+/* Only time_task (and time_svc_init, before any task) publishes g_tm.
+ * The critical section keeps a higher-priority reader on this core from
+ * preempting a half-written snapshot; readers on another core retry. */
+static void publish_localtime(const struct tm *local, time_t epoch)
+{
+    portENTER_CRITICAL(&s_tm_mux);
+    __atomic_store_n(&g_tm_seq, g_tm_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    g_tm = *local;
+    s_snap_epoch = epoch;
+    __atomic_store_n(&g_tm_seq, g_tm_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&s_tm_mux);
+}
+
+static void publish_anchor(int64_t epoch_us, int64_t mono_us, int32_t drift_ppb)
+{
+    portENTER_CRITICAL(&s_tm_mux);
+    __atomic_store_n(&g_tm_seq, g_tm_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s_anchor.epoch_us = epoch_us;
+    s_anchor.mono_us = mono_us;
+    s_anchor.drift_ppb = drift_ppb;
+    __atomic_store_n(&g_tm_seq, g_tm_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&s_tm_mux);
+}
+
+static void read_anchor(time_anchor_t *a)
+{
+    uint32_t s1, s2;
+    do {
+        s1 = __atomic_load_n(&g_tm_seq, __ATOMIC_ACQUIRE);
+        *a = s_anchor;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&g_tm_seq, __ATOMIC_RELAXED);
+    } while ((s1 & 1) || s1 != s2);
+}
+
+/* Raw estimate: what the uncorrected system clock should read. */
+static inline int64_t anchor_raw_us(const time_anchor_t *a, int64_t mono)
+{
+    return a->epoch_us + (mono - a->mono_us);
+}
+
+/* Drift-corrected wall clock. A fast oscillator (positive ppb) is slowed down. */
+static inline int64_t anchor_now_us(const time_anchor_t *a, int64_t mono)
+{
+    int64_t elapsed = mono - a->mono_us;
+    return a->epoch_us + elapsed - elapsed * a->drift_ppb / 1000000000LL;
+}
+
+/* Step a broken-down time forward by one second. Returns false when the
+ * hour rolls over; the caller then redoes a full conversion, which also
+ * picks up day/month/year changes and DST shifts. */
+static bool tm_advance_second(struct tm *t)
+{
+    if (++t->tm_sec < 60) return true;
+    t->tm_sec = 0;
+    if (++t->tm_min < 60) return true;
+    t->tm_min = 0;
+    return false;
+}
+
+static void time_engine_full_sync(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t mono = esp_timer_get_time();
+
+    s_cached_epoch = tv.tv_sec;
+    localtime_r(&s_cached_epoch, &s_cached);
+    s_full_conversions++;
+
+    publish_anchor((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec, mono,
+                   __atomic_load_n(&s_drift_ppb, __ATOMIC_RELAXED));
+    publish_localtime(&s_cached, s_cached_epoch);
+    alarm_notify_clock_change();
+    ble_alarm_adv_refresh();
+}
+
+/* Last known wall clock, kept in RTC memory (survives soft resets, panics
+ * and deep sleep while the RTC timer keeps counting) and checkpointed to
+ * NVS (survives power loss, but the off time is unknown). */
+#define TIME_PERSIST_MAGIC      0x54494D45u   // "TIME"
+#define TIME_VALID_EPOCH        1577836800LL  // 2020-01-01, anything older is unset
+#define TIME_NVS_NAMESPACE      "time"
+#define TIME_NVS_KEY            "epoch_us"
+#define TIME_NVS_PERIOD_US      (3600LL * 1000000LL)
+
+typedef struct {
+    uint32_t magic;
+    int64_t  epoch_us;
+    uint64_t rtc_us;      // esp_rtc_get_time_us() when epoch_us was taken
+    uint32_t check;
+} time_rtc_state_t;
+
+static RTC_NOINIT_ATTR time_rtc_state_t s_rtc_state;
+static int64_t s_nvs_saved_mono_us = -1;
+static volatile bool s_time_verified = false;
+
+static uint32_t rtc_state_check(const time_rtc_state_t *st)
+{
+    return st->magic ^ (uint32_t)st->epoch_us ^ (uint32_t)(st->epoch_us >> 32)
+         ^ (uint32_t)st->rtc_us ^ (uint32_t)(st->rtc_us >> 32);
+}
+
+static void time_persist_rtc(int64_t epoch_us)
+{
+    if (epoch_us / 1000000LL < TIME_VALID_EPOCH) return;
+    s_rtc_state.magic = TIME_PERSIST_MAGIC;
+    s_rtc_state.epoch_us = epoch_us;
+    s_rtc_state.rtc_us = esp_rtc_get_time_us();
+    s_rtc_state.check = rtc_state_check(&s_rtc_state);
+}
+
+static void time_persist_nvs(int64_t epoch_us)
+{
+    if (epoch_us / 1000000LL < TIME_VALID_EPOCH) return;
+    nvs_handle_t h;
+    if (nvs_open(TIME_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return;
+    if (nvs_set_i64(h, TIME_NVS_KEY, epoch_us) == ESP_OK) nvs_commit(h);
+    nvs_close(h);
+    s_nvs_saved_mono_us = esp_timer_get_time();
+}
+
+/* Runs from time_svc_init before any task: if the system clock is unset,
+ * seed it from RTC memory or the NVS checkpoint. The result stays
+ * unverified until NTP confirms it. */
+static void time_restore_boot(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec >= TIME_VALID_EPOCH) return;
+
+    int64_t epoch_us = 0;
+    const char *src = NULL;
+    uint64_t rtc_now = esp_rtc_get_time_us();
+    if (s_rtc_state.magic == TIME_PERSIST_MAGIC &&
+        s_rtc_state.check == rtc_state_check(&s_rtc_state) &&
+        rtc_now >= s_rtc_state.rtc_us) {
+        epoch_us = s_rtc_state.epoch_us + (int64_t)(rtc_now - s_rtc_state.rtc_us);
+        src = "RTC";
+    } else {
+        nvs_handle_t h;
+        if (nvs_open(TIME_NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+            if (nvs_get_i64(h, TIME_NVS_KEY, &epoch_us) == ESP_OK) src = "NVS";
+            nvs_close(h);
+        }
+    }
+    if (!src || epoch_us / 1000000LL < TIME_VALID_EPOCH) {
+        ESP_LOGW(TAGT, "No persisted time, waiting for NTP");
+        return;
+    }
+
+    tv.tv_sec = (time_t)(epoch_us / 1000000LL);
+    tv.tv_usec = (suseconds_t)(epoch_us % 1000000LL);
+    settimeofday(&tv, NULL);
+    ESP_LOGI(TAGT, "Restored unverified time from %s at %lld ms after boot",
+             src, (long long)(esp_timer_get_time() / 1000));
+}
+
+static void time_mark_verified(void)
+{
+    if (!s_time_verified) {
+        ESP_LOGI(TAGT, "Time verified by NTP %lld ms after boot",
+                 (long long)(esp_timer_get_time() / 1000));
+    }
+    s_time_verified = true;
+    __atomic_store_n(&s_reanchor_req, true, __ATOMIC_RELEASE);
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    time_persist_nvs((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec);
+    display_request_refresh();
+    ble_alarm_adv_refresh();
+}
+
+static void time_engine_tick(void)
+{
+    int64_t mono = esp_timer_get_time();
+    int64_t raw_us = anchor_raw_us(&s_anchor, mono);
+    int64_t now_us = anchor_now_us(&s_anchor, mono);
+
+    // SNTP or settimeofday() stepped the system clock
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t sys_us = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+    if (__atomic_exchange_n(&s_reanchor_req, false, __ATOMIC_ACQ_REL)) {
+        time_engine_full_sync();
+        return;
+    }
+    if (llabs(sys_us - raw_us) > TIME_STEP_THRESHOLD_US) {
+        ESP_LOGI(TAGT, "Clock stepped by %lld ms, re-anchoring",
+                 (long long)((sys_us - raw_us) / 1000));
+        time_engine_full_sync();
+        return;
+    }
+
+    time_t now = (time_t)(now_us / 1000000LL);
+    while (s_cached_epoch < now) {
+        s_cached_epoch++;
+        if (!tm_advance_second(&s_cached)) {
+            s_cached_epoch = now;
+            localtime_r(&s_cached_epoch, &s_cached);
+            s_full_conversions++;
+            break;
+        }
+    }
+    publish_localtime(&s_cached, s_cached_epoch);
+}
+
 
 static void sntp_set_server_with_fallback(int idx, const char *hostname, const char *ip_fallback)
 {
@@ -23,6 +286,73 @@ static void sntp_set_server_with_fallback(int idx, const char *hostname, const c
 }
 
 
+#define NTP_RACE_TIMEOUT_MS 3000
+
+static ntp_server_t s_ntp_servers[] = {
+    { .host = "time.google.com",   .ip_fallback = "216.239.35.0" },
+    { .host = "pool.ntp.org",      .ip_fallback = "129.6.15.28" },
+    { .host = "0.vn.pool.ntp.org", .ip_fallback = "120.72.88.22" },
+};
+#define NTP_SERVER_COUNT (int)(sizeof(s_ntp_servers)/sizeof(s_ntp_servers[0]))
+
+/* offset_us is the correction NTP just applied to the raw system clock,
+ * i.e. what the oscillator drifted since the previous sync. Fold it into
+ * the drift estimate and size the next interval so the error left after
+ * correction stays inside the budget. */
+static void drift_update(int64_t offset_us)
+{
+    int64_t mono = esp_timer_get_time();
+    int64_t span = mono - s_last_sync_mono_us;
+    bool have_span = s_last_sync_mono_us >= 0 && span >= DRIFT_MIN_SPAN_US;
+    s_last_sync_mono_us = mono;
+    if (!have_span) return;
+
+    int32_t old_ppb = s_drift_ppb;
+    int32_t measured = (int32_t)(-offset_us * 1000000000LL / span);
+    int32_t residual = s_drift_valid ? abs(measured - old_ppb) : abs(measured);
+    int32_t ppb = s_drift_valid ? old_ppb + (measured - old_ppb) / 2 : measured;
+    s_drift_valid = true;
+    __atomic_store_n(&s_drift_ppb, ppb, __ATOMIC_RELAXED);
+
+    if (residual < DRIFT_RESIDUAL_FLOOR_PPB) residual = DRIFT_RESIDUAL_FLOOR_PPB;
+    int64_t interval = (int64_t)s_error_budget_ms * 1000000LL / residual;
+    if (interval < NTP_INTERVAL_MIN_S) interval = NTP_INTERVAL_MIN_S;
+    if (interval > NTP_INTERVAL_MAX_S) interval = NTP_INTERVAL_MAX_S;
+    s_ntp_interval_s = (uint32_t)interval;
+
+    ESP_LOGI(TAGT, "Drift: measured %ld ppb over %lld s, estimate %ld ppb, next sync in %lu s",
+             (long)measured, (long long)(span / 1000000), (long)ppb, (unsigned long)s_ntp_interval_s);
+}
+
+/* Query all servers at once and step the clock from the winning reply. */
+static bool try_time_sync_race(ntp_race_mode_t mode)
+{
+    ntp_race_result_t r;
+    bool ok = ntp_race_query(s_ntp_servers, NTP_SERVER_COUNT, mode, NTP_RACE_TIMEOUT_MS, &r);
+
+    for (int i = 0; i < NTP_SERVER_COUNT; ++i) {
+        const ntp_server_t *s = &s_ntp_servers[i];
+        ESP_LOGI(TAGT, "NTP %-18s ok %lu/%lu rtt %ld ms", s->host,
+                 (unsigned long)s->successes, (unsigned long)s->attempts, (long)s->last_rtt_ms);
+    }
+    if (!ok) return false;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t us = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec + r.offset_us;
+    tv.tv_sec = (time_t)(us / 1000000LL);
+    tv.tv_usec = (suseconds_t)(us % 1000000LL);
+    settimeofday(&tv, NULL);
+    drift_update(r.offset_us);
+    time_mark_verified();
+
+    ESP_LOGI(TAGT, "Time synced via %s (race): offset %lld ms, rtt %lld ms",
+             s_ntp_servers[r.server].host, (long long)(r.offset_us / 1000), (long long)(r.rtt_us / 1000));
+    return true;
+}
+
+/* SNTP is stopped again on return: left running it would keep stepping
+ * the clock behind the race path, which also feeds the drift estimate. */
 static bool try_time_sync_multi_servers(void)
 {
     const struct { const char *host; const char *ip; } servers[] = {
@@ -43,73 +373,194 @@ static bool try_time_sync_multi_servers(void)
             struct tm tmv = {0};
             time(&now);
             localtime_r(&now, &tmv);
-            if (tmv.tm_year >= (2020 - 1900)) {
+            // a restored boot time already looks valid, so wait for SNTP itself
+            if (sntp_get_sync_status() == SNTP_SYNC_STATUS_COMPLETED) {
                 ESP_LOGI(TAGT, "Time synced via %s: %04d-%02d-%02d %02d:%02d:%02d",
                          servers[i].host, tmv.tm_year+1900, tmv.tm_mon+1, tmv.tm_mday,
                          tmv.tm_hour, tmv.tm_min, tmv.tm_sec);
+                sntp_stop();
                 return true;
             }
             vTaskDelay(pdMS_TO_TICKS(1000));
         }
     }
+    sntp_stop();
     return false;
 }
 
 static void time_task(void *arg)
 {
     while (1) {
-        time_t now;
-        struct tm local;
-        time(&now);
-        localtime_r(&now, &local);
-
-        if (g_time_mutex && xSemaphoreTake(g_time_mutex, pdMS_TO_TICKS(100))) {
-            g_tm = local;
-            xSemaphoreGive(g_time_mutex);
+        time_engine_tick();
+
+        int64_t now_us = time_svc_now_ms() * 1000LL;
+        time_persist_rtc(now_us);
+        if (s_time_verified && (s_nvs_saved_mono_us < 0 ||
+            esp_timer_get_time() - s_nvs_saved_mono_us >= TIME_NVS_PERIOD_US)) {
+            time_persist_nvs(now_us);
         }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+
+        // wake just after the next second boundary
+        int ms_left = 1000 - (int)(time_svc_now_ms() % 1000);
+        vTaskDelay(pdMS_TO_TICKS(ms_left) + 1);
     }
 }
 
+/* The sequential SNTP path reports no offset; restart the drift baseline. */
+static bool try_time_sync_fallback(void)
+{
+    if (!try_time_sync_multi_servers()) return false;
+    s_last_sync_mono_us = esp_timer_get_time();
+    time_mark_verified();
+    return true;
+}
+
 static void ntp_task(void *arg)
 {
     if (s_wifi_event_group) {
         xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
     }
 
-    if (!try_time_sync_multi_servers()) {
+    // first valid reply wins at boot; periodic syncs wait for the lowest RTT
+    if (!try_time_sync_race(NTP_RACE_FIRST) && !try_time_sync_fallback()) {
         ESP_LOGW(TAGT, "Time not synced initially; using local time until sync.");
     }
 
-    const TickType_t delay_hour = pdMS_TO_TICKS(3600UL * 1000UL);
     while (1) {
-        vTaskDelay(delay_hour);
+        vTaskDelay((TickType_t)s_ntp_interval_s * configTICK_RATE_HZ);
         ESP_LOGI(TAGT, "Periodic NTP sync...");
-        try_time_sync_multi_servers();
+        if (!try_time_sync_race(NTP_RACE_BEST_RTT)) try_time_sync_fallback();
     }
 }
 
 void time_svc_init(void)
 {
-    if (!g_time_mutex) g_time_mutex = xSemaphoreCreateMutex();
     time_set_timezone_vn();
+    time_restore_boot();
+    time_engine_full_sync();
+}
+
+#if TIME_SVC_BENCH
+#include "esp_cpu.h"
+
+/* Build with -DTIME_SVC_BENCH=1 to log the cost of one time read,
+ * seqlock snapshot vs. the old mutex-guarded copy. */
+static void time_svc_bench(void)
+{
+    const int n = 10000;
+    struct tm tmv;
+    SemaphoreHandle_t mtx = xSemaphoreCreateMutex();
+
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < n; ++i) {
+        if (xSemaphoreTake(mtx, pdMS_TO_TICKS(50))) {
+            tmv = g_tm;
+            xSemaphoreGive(mtx);
+        }
+    }
+    uint32_t c1 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < n; ++i) time_svc_get_localtime(&tmv);
+    uint32_t c2 = esp_cpu_get_cycle_count();
+
+    vSemaphoreDelete(mtx);
+    ESP_LOGI(TAGT, "read cost: mutex %lu cycles, seqlock %lu cycles",
+             (unsigned long)((c1 - c0) / n), (unsigned long)((c2 - c1) / n));
 }
+#endif
 
 void time_svc_start_tasks(void)
 {
-    xTaskCreate(time_task, "time_task", 2048, NULL, 5, NULL);
+#if TIME_SVC_BENCH
+    time_svc_bench();
+#endif
+    xTaskCreate(time_task, "time_task", 3072, NULL, 5, NULL);
     xTaskCreate(ntp_task,  "ntp_task",  4096, NULL, 5, NULL);
 }
 
 bool time_svc_get_localtime(struct tm *out)
 {
     if (!out) return false;
-    if (g_time_mutex && xSemaphoreTake(g_time_mutex, pdMS_TO_TICKS(50))) {
+    uint32_t s1, s2;
+    do {
+        s1 = __atomic_load_n(&g_tm_seq, __ATOMIC_ACQUIRE);
+        *out = g_tm;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&g_tm_seq, __ATOMIC_RELAXED);
+    } while ((s1 & 1) || s1 != s2);
+    return true;
+}
+
+int64_t time_svc_now_ms(void)
+{
+    time_anchor_t a;
+    read_anchor(&a);
+    return anchor_now_us(&a, esp_timer_get_time()) / 1000;
+}
+
+bool time_svc_get_localtime_ms(struct tm *out, int *ms)
+{
+    if (!out) return false;
+    time_anchor_t a;
+    time_t snap;
+    uint32_t s1, s2;
+    do {
+        s1 = __atomic_load_n(&g_tm_seq, __ATOMIC_ACQUIRE);
         *out = g_tm;
-        xSemaphoreGive(g_time_mutex);
-        return true;
+        snap = s_snap_epoch;
+        a = s_anchor;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&g_tm_seq, __ATOMIC_RELAXED);
+    } while ((s1 & 1) || s1 != s2);
+
+    int64_t now_ms = anchor_now_us(&a, esp_timer_get_time()) / 1000;
+    time_t now = (time_t)(now_ms / 1000);
+
+    // time_task may not have ticked past the boundary yet
+    while (snap < now) {
+        snap++;
+        if (!tm_advance_second(out)) {
+            snap = now;
+            localtime_r(&snap, out);
+            break;
+        }
     }
-    time_t now; time(&now);
-    localtime_r(&now, out);
+    if (ms) *ms = (int)(now_ms % 1000);
     return true;
 }
+
+uint32_t time_svc_full_conversions(void)
+{
+    return s_full_conversions;
+}
+
+int time_svc_get_ntp_stats(ntp_server_t *out, int max)
+{
+    int n = (max < NTP_SERVER_COUNT) ? max : NTP_SERVER_COUNT;
+    for (int i = 0; i < n; ++i) out[i] = s_ntp_servers[i];
+    return n;
+}
+
+int32_t time_svc_drift_ppb(void)
+{
+    return s_drift_ppb;
+}
+
+uint32_t time_svc_ntp_interval_s(void)
+{
+    return s_ntp_interval_s;
+}
+
+void time_svc_set_error_budget_ms(uint32_t ms)
+{
+    if (ms > 0) s_error_budget_ms = ms;
+}
+
+bool time_svc_is_verified(void)
+{
+    return s_time_verified;
+}
+
+bool time_svc_is_valid(void)
+{
+    return time_svc_now_ms() / 1000 >= TIME_VALID_EPOCH;
+}
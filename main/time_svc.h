@@ -1,7 +1,18 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
+#include "ntp_race.h"
 
 void time_svc_init(void);          
 void time_svc_start_tasks(void);   
 bool time_svc_get_localtime(struct tm *out); 
+bool time_svc_get_localtime_ms(struct tm *out, int *ms);
+int64_t time_svc_now_ms(void);              // epoch ms, advanced from esp_timer
+uint32_t time_svc_full_conversions(void);   // localtime_r calls made by the engine
+int time_svc_get_ntp_stats(ntp_server_t *out, int max);   // per-server RTT/success counters
+int32_t time_svc_drift_ppb(void);           // estimated oscillator drift, + = fast
+uint32_t time_svc_ntp_interval_s(void);     // current adaptive resync interval
+void time_svc_set_error_budget_ms(uint32_t ms);
+bool time_svc_is_valid(void);               // clock holds a plausible (>= 2020) time
+bool time_svc_is_verified(void);            // false until NTP confirms a restored boot time
@@ -0,0 +1,84 @@
+#include <string.h>
+#include "timer_wheel.h"
+
+void tw_init(tw_wheel_t *w)
+{
+    memset(w, 0, sizeof(*w));
+    memset(w->head, -1, sizeof(w->head));
+    w->next_id = 1;
+}
+
+static int find_index(const tw_wheel_t *w, uint8_t id)
+{
+    if (!id) return -1;
+    for (int i = 0; i < TW_MAX_TIMERS; ++i)
+        if (w->t[i].id == id) return i;
+    return -1;
+}
+
+int tw_add(tw_wheel_t *w, uint32_t delay_ticks)
+{
+    int i;
+    for (i = 0; i < TW_MAX_TIMERS && w->t[i].id; ++i) {}
+    if (i >= TW_MAX_TIMERS) return -1;
+    if (delay_ticks == 0) delay_ticks = 1;
+
+    uint8_t id;
+    do {
+        id = w->next_id++;
+        if (!w->next_id) w->next_id = 1;
+    } while (!id || find_index(w, id) >= 0);
+
+    tw_timer_t *t = &w->t[i];
+    t->id = id;
+    t->expire_tick = w->now_tick + delay_ticks;
+    t->duration_ticks = delay_ticks;
+
+    uint32_t s = t->expire_tick & (TW_SLOTS - 1);
+    t->next = w->head[s];
+    w->head[s] = (int8_t)i;
+    w->count++;
+    return id;
+}
+
+/* Unlink index i from its slot chain and free it. */
+static void unlink_free(tw_wheel_t *w, int i)
+{
+    uint32_t s = w->t[i].expire_tick & (TW_SLOTS - 1);
+    int8_t *pp = &w->head[s];
+    while (*pp >= 0 && *pp != i) pp = &w->t[(int)*pp].next;
+    if (*pp == i) *pp = w->t[i].next;
+    memset(&w->t[i], 0, sizeof(w->t[i]));
+    w->count--;
+}
+
+bool tw_cancel(tw_wheel_t *w, uint8_t id)
+{
+    int i = find_index(w, id);
+    if (i < 0) return false;
+    unlink_free(w, i);
+    return true;
+}
+
+const tw_timer_t *tw_find(const tw_wheel_t *w, uint8_t id)
+{
+    int i = find_index(w, id);
+    return i < 0 ? NULL : &w->t[i];
+}
+
+int tw_tick(tw_wheel_t *w, uint8_t *expired, int max)
+{
+    int n = 0;
+    w->now_tick++;
+    int8_t i = w->head[w->now_tick & (TW_SLOTS - 1)];
+    while (i >= 0) {
+        int8_t next = w->t[(int)i].next;
+        // later rounds of the wheel share the slot; only this tick's timers go
+        if (w->t[(int)i].expire_tick == w->now_tick) {
+            if (n < max) expired[n++] = w->t[(int)i].id;
+            unlink_free(w, i);
+        }
+        i = next;
+    }
+    return n;
+}
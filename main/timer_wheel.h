@@ -0,0 +1,42 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hashed timer wheel with one tick per slot step. A timer hangs in slot
+ * expire_tick % TW_SLOTS; each tick walks only the current slot, so add,
+ * cancel and tick are O(1) amortised no matter how far out timers are.
+ * Plain C; callers provide locking and the tick source. */
+
+#define TW_SLOTS      64     // power of two
+#define TW_MAX_TIMERS 8
+
+typedef struct {
+    uint8_t  id;             // 0 = free
+    int8_t   next;           // next index in the slot chain, -1 = end
+    uint32_t expire_tick;
+    uint32_t duration_ticks;
+} tw_timer_t;
+
+typedef struct {
+    int8_t     head[TW_SLOTS];
+    tw_timer_t t[TW_MAX_TIMERS];
+    uint32_t   now_tick;
+    uint8_t    next_id;
+    uint8_t    count;
+} tw_wheel_t;
+
+void tw_init(tw_wheel_t *w);
+// expire delay_ticks (>= 1) from now; returns id or -1 when full
+int  tw_add(tw_wheel_t *w, uint32_t delay_ticks);
+bool tw_cancel(tw_wheel_t *w, uint8_t id);
+const tw_timer_t *tw_find(const tw_wheel_t *w, uint8_t id);
+// advance one tick; ids that expire are written to expired (up to max), count returned
+int  tw_tick(tw_wheel_t *w, uint8_t *expired, int max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,112 @@
+#include "tone.h"
+#include "app_state.h"
+#include "driver/ledc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAGT = "tone";
+
+#define TONE_LEDC_MODE    LEDC_LOW_SPEED_MODE
+#define TONE_LEDC_TIMER   LEDC_TIMER_0
+#define TONE_LEDC_CHANNEL LEDC_CHANNEL_0
+#define TONE_LEDC_RES     LEDC_TIMER_10_BIT
+#define TONE_DUTY_FULL    (1u << 10)
+
+static tone_mixer_t s_mix;
+static tone_out_t s_out;                 // what LEDC currently plays
+static esp_timer_handle_t s_timer = NULL;
+static SemaphoreHandle_t s_mtx = NULL;
+
+static void ledc_apply(const tone_out_t *o)
+{
+    if (o->duty_pm && o->freq_hz && o->freq_hz != s_out.freq_hz) {
+        ledc_set_freq(TONE_LEDC_MODE, TONE_LEDC_TIMER, o->freq_hz);
+    }
+    uint16_t duty_pm = o->freq_hz ? o->duty_pm : 0;
+    if (duty_pm != s_out.duty_pm) {
+        ledc_set_duty(TONE_LEDC_MODE, TONE_LEDC_CHANNEL, (uint32_t)duty_pm * TONE_DUTY_FULL / 1000);
+        ledc_update_duty(TONE_LEDC_MODE, TONE_LEDC_CHANNEL);
+    }
+    if (duty_pm) s_out.freq_hz = o->freq_hz;
+    s_out.duty_pm = duty_pm;
+}
+
+/* Caller holds s_mtx. */
+static void tone_update_locked(void)
+{
+    int64_t now = esp_timer_get_time();
+    tone_out_t o;
+    int64_t next = tone_mixer_step(&s_mix, now, &o);
+    ledc_apply(&o);
+
+    esp_timer_stop(s_timer);
+    if (next >= 0) esp_timer_start_once(s_timer, next > now ? (uint64_t)(next - now) : 1);
+}
+
+static void tone_timer_cb(void *arg)
+{
+    xSemaphoreTake(s_mtx, portMAX_DELAY);
+    tone_update_locked();
+    xSemaphoreGive(s_mtx);
+}
+
+esp_err_t tone_init(void)
+{
+    ledc_timer_config_t tcfg = {
+        .speed_mode = TONE_LEDC_MODE,
+        .duty_resolution = TONE_LEDC_RES,
+        .timer_num = TONE_LEDC_TIMER,
+        .freq_hz = 2000,
+        .clk_cfg = LEDC_AUTO_CLK,
+    };
+    esp_err_t err = ledc_timer_config(&tcfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAGT, "LEDC timer: %s", esp_err_to_name(err));
+        return err;
+    }
+    ledc_channel_config_t ccfg = {
+        .gpio_num = BUZZER_GPIO,
+        .speed_mode = TONE_LEDC_MODE,
+        .channel = TONE_LEDC_CHANNEL,
+        .timer_sel = TONE_LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0,
+        .flags.output_invert = BUZZER_ACTIVE_LEVEL ? 0 : 1,
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&ccfg));
+    s_out.freq_hz = 2000;
+
+    tone_mixer_init(&s_mix);
+    s_mtx = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t targs = {
+        .callback = tone_timer_cb,
+        .name = "tone",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&targs, &s_timer));
+    return ESP_OK;
+}
+
+void tone_play(tone_voice_t v, const tone_seq_t *seq)
+{
+    if (!s_mtx) return;
+    xSemaphoreTake(s_mtx, portMAX_DELAY);
+    tone_mixer_start(&s_mix, v, seq, esp_timer_get_time());
+    tone_update_locked();
+    xSemaphoreGive(s_mtx);
+}
+
+void tone_stop(tone_voice_t v)
+{
+    if (!s_mtx) return;
+    xSemaphoreTake(s_mtx, portMAX_DELAY);
+    tone_mixer_stop(&s_mix, v);
+    tone_update_locked();
+    xSemaphoreGive(s_mtx);
+}
+
+bool tone_active(tone_voice_t v)
+{
+    return tone_mixer_active(&s_mix, v);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdbool.h>
+#include "esp_err.h"
+#include "tone_seq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Buzzer tone engine: LEDC PWM on BUZZER_GPIO, stepped by an esp_timer
+ * so note changes and volume ramps never need a polling task. */
+
+esp_err_t tone_init(void);
+
+// (re)start seq on voice v; a higher voice masks the lower ones
+void tone_play(tone_voice_t v, const tone_seq_t *seq);
+void tone_stop(tone_voice_t v);
+bool tone_active(tone_voice_t v);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,181 @@
+#include <string.h>
+#include "tone_seq.h"
+
+#define TONE_STEP_US   10000
+// volume ramps move in steps of this size
+#define TONE_RAMP_US   100000
+// full volume is a 50 % square wave
+#define TONE_DUTY_MAX_PM 500
+
+static const tone_step_t s_click[]   = { {96, 3} };
+static const tone_step_t s_confirm[] = { {84, 12}, {88, 12}, {91, 12}, {96, 30} };
+static const tone_step_t s_ring[]    = {
+    {72, 15}, {0, 5}, {76, 15}, {0, 5}, {79, 15}, {0, 5}, {84, 30}, {0, 50}
+};
+
+const tone_seq_t TONE_CLICK   = { s_click,   1, 60, 60, 0, false };
+const tone_seq_t TONE_CONFIRM = { s_confirm, 4, 80, 80, 0, false };
+const tone_seq_t TONE_RING    = { s_ring, sizeof(s_ring) / sizeof(s_ring[0]), 10, 100, 30, true };
+
+// C4..B4 in centi-Hz; other octaves shift
+static const uint32_t s_octave4_chz[12] = {
+    26163, 27718, 29366, 31113, 32963, 34923,
+    36999, 39200, 41530, 44000, 46616, 49388
+};
+
+uint16_t tone_note_hz(uint8_t note)
+{
+    if (note == 0) return 0;
+    int oct = note / 12 - 5;   // MIDI 60 = C4
+    uint32_t chz = s_octave4_chz[note % 12];
+    if (oct >= 0) chz <<= oct;
+    else          chz >>= -oct;
+    return (uint16_t)((chz + 50) / 100);
+}
+
+void tone_mixer_init(tone_mixer_t *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+void tone_mixer_start(tone_mixer_t *m, tone_voice_t v, const tone_seq_t *seq, int64_t now_us)
+{
+    tone_voice_state_t *s = &m->v[v];
+    s->seq = seq;
+    s->idx = 0;
+    s->start_us = now_us;
+    s->step_end_us = now_us + (int64_t)seq->steps[0].len * TONE_STEP_US;
+}
+
+void tone_mixer_stop(tone_mixer_t *m, tone_voice_t v)
+{
+    m->v[v].seq = NULL;
+}
+
+bool tone_mixer_active(const tone_mixer_t *m, tone_voice_t v)
+{
+    return m->v[v].seq != NULL;
+}
+
+static uint8_t voice_vol(const tone_voice_state_t *s, int64_t now_us)
+{
+    const tone_seq_t *q = s->seq;
+    if (!q->ramp_s) return q->vol;
+    int64_t ramp_us = (int64_t)q->ramp_s * 1000000LL;
+    int64_t t = now_us - s->start_us;
+    if (t >= ramp_us) return q->vol_end;
+    t -= t % TONE_RAMP_US;   // hold each ramp step so the output only changes on events
+    return (uint8_t)(q->vol + ((int)q->vol_end - q->vol) * t / ramp_us);
+}
+
+int64_t tone_mixer_step(tone_mixer_t *m, int64_t now_us, tone_out_t *out)
+{
+    int64_t next = -1;
+    out->freq_hz = 0;
+    out->duty_pm = 0;
+
+    for (int v = 0; v < TONE_VOICE_COUNT; ++v) {
+        tone_voice_state_t *s = &m->v[v];
+        if (!s->seq) continue;
+
+        // masked voices advance too, so the ring resumes in time after a click
+        while (s->step_end_us <= now_us) {
+            if (++s->idx >= s->seq->n) {
+                if (!s->seq->loop) { s->seq = NULL; break; }
+                s->idx = 0;
+            }
+            s->step_end_us += (int64_t)s->seq->steps[s->idx].len * TONE_STEP_US;
+        }
+        if (!s->seq) continue;
+
+        int64_t ev = s->step_end_us;
+        if (s->seq->ramp_s && now_us - s->start_us < (int64_t)s->seq->ramp_s * 1000000LL) {
+            int64_t r = now_us + TONE_RAMP_US - (now_us - s->start_us) % TONE_RAMP_US;
+            if (r < ev) ev = r;
+        }
+        if (next < 0 || ev < next) next = ev;
+
+        // highest active voice wins
+        uint8_t note = s->seq->steps[s->idx].note;
+        uint32_t vol = voice_vol(s, now_us);
+        out->freq_hz = tone_note_hz(note);
+        out->duty_pm = note ? (uint16_t)(TONE_DUTY_MAX_PM * vol * vol / 10000) : 0;
+    }
+    return next;
+}
+
+#ifndef ESP_PLATFORM
+#include <stdio.h>
+
+static void put_le(FILE *f, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) fputc((v >> (8 * i)) & 0xFF, f);
+}
+
+bool tone_render_wav(const char *path, const tone_seq_t *const seqs[TONE_VOICE_COUNT],
+                     const uint32_t start_ms[TONE_VOICE_COUNT], uint32_t total_ms,
+                     uint32_t sample_rate)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+
+    uint32_t samples = (uint32_t)((uint64_t)total_ms * sample_rate / 1000);
+    uint32_t data_len = samples * 2;
+    fwrite("RIFF", 1, 4, f); put_le(f, 36 + data_len, 4);
+    fwrite("WAVEfmt ", 1, 8, f);
+    put_le(f, 16, 4); put_le(f, 1, 2); put_le(f, 1, 2);
+    put_le(f, sample_rate, 4); put_le(f, sample_rate * 2, 4);
+    put_le(f, 2, 2); put_le(f, 16, 2);
+    fwrite("data", 1, 4, f); put_le(f, data_len, 4);
+
+    tone_mixer_t m;
+    tone_mixer_init(&m);
+    bool started[TONE_VOICE_COUNT] = {0};
+    tone_out_t out = {0};
+    int64_t next = 0;
+    double phase = 0;
+
+    for (uint32_t i = 0; i < samples; ++i) {
+        int64_t t_us = (int64_t)i * 1000000LL / sample_rate;
+        for (int v = 0; v < TONE_VOICE_COUNT; ++v) {
+            if (seqs[v] && !started[v] && t_us >= (int64_t)start_ms[v] * 1000) {
+                tone_mixer_start(&m, (tone_voice_t)v, seqs[v], t_us);
+                started[v] = true;
+                next = t_us;
+            }
+        }
+        if (next >= 0 && t_us >= next) next = tone_mixer_step(&m, t_us, &out);
+
+        // the PWM waveform the buzzer sees, high for duty of each period
+        int16_t s = 0;
+        if (out.duty_pm && out.freq_hz) {
+            phase += (double)out.freq_hz / sample_rate;
+            phase -= (int)phase;
+            s = phase * 1000 < out.duty_pm ? 12000 : -12000;
+        }
+        put_le(f, (uint16_t)s, 2);
+    }
+    return fclose(f) == 0;
+}
+
+#ifdef TONE_RENDER_MAIN
+/* cc -DTONE_RENDER_MAIN -Imain main/tone_seq.c -o tone_render && ./tone_render */
+int main(void)
+{
+    const uint32_t at0[TONE_VOICE_COUNT] = {0};
+    const tone_seq_t *click[TONE_VOICE_COUNT]   = { [TONE_VOICE_CLICK]   = &TONE_CLICK };
+    const tone_seq_t *confirm[TONE_VOICE_COUNT] = { [TONE_VOICE_CONFIRM] = &TONE_CONFIRM };
+    const tone_seq_t *ring[TONE_VOICE_COUNT]    = { [TONE_VOICE_RING]    = &TONE_RING };
+    // ring masks the click and the confirm started under it
+    const tone_seq_t *mix[TONE_VOICE_COUNT] = { &TONE_CLICK, &TONE_CONFIRM, &TONE_RING };
+    const uint32_t mix_at[TONE_VOICE_COUNT] = { 200, 400, 1000 };
+
+    bool ok = tone_render_wav("click.wav", click, at0, 100, 44100)
+           && tone_render_wav("confirm.wav", confirm, at0, 1000, 44100)
+           && tone_render_wav("ring.wav", ring, at0, 35000, 44100)
+           && tone_render_wav("mix.wav", mix, mix_at, 4000, 44100);
+    puts(ok ? "wrote click.wav confirm.wav ring.wav mix.wav" : "render failed");
+    return ok ? 0 : 1;
+}
+#endif
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tone sequencer and priority mixer, independent of the hardware: the
+ * LEDC/esp_timer glue lives in tone.c, and a host build can render
+ * sequences to WAV (see tone_render_wav). */
+
+typedef struct {
+    uint8_t note;   // MIDI note number, 0 = rest
+    uint8_t len;    // duration in 10 ms units
+} tone_step_t;
+
+typedef struct {
+    const tone_step_t *steps;
+    uint16_t n;
+    uint8_t  vol;       // 0..100 at start
+    uint8_t  vol_end;   // 0..100 reached after ramp_s
+    uint16_t ramp_s;    // 0 = constant vol
+    bool     loop;
+} tone_seq_t;
+
+// a higher voice masks the lower ones; masked voices keep their timeline
+typedef enum {
+    TONE_VOICE_CLICK = 0,
+    TONE_VOICE_CONFIRM,
+    TONE_VOICE_RING,
+    TONE_VOICE_COUNT
+} tone_voice_t;
+
+typedef struct {
+    uint16_t freq_hz;
+    uint16_t duty_pm;   // PWM duty in permille, 0 = silent
+} tone_out_t;
+
+typedef struct {
+    const tone_seq_t *seq;
+    uint16_t idx;
+    int64_t  start_us;
+    int64_t  step_end_us;
+} tone_voice_state_t;
+
+typedef struct {
+    tone_voice_state_t v[TONE_VOICE_COUNT];
+} tone_mixer_t;
+
+extern const tone_seq_t TONE_CLICK;
+extern const tone_seq_t TONE_CONFIRM;
+extern const tone_seq_t TONE_RING;   // gentle wake: loops, ramps up over 30 s
+
+uint16_t tone_note_hz(uint8_t note);
+
+void tone_mixer_init(tone_mixer_t *m);
+void tone_mixer_start(tone_mixer_t *m, tone_voice_t v, const tone_seq_t *seq, int64_t now_us);
+void tone_mixer_stop(tone_mixer_t *m, tone_voice_t v);
+bool tone_mixer_active(const tone_mixer_t *m, tone_voice_t v);
+
+/* Advance every voice to now_us and write what the output should be.
+ * Returns the next instant the output may change, -1 once all voices end. */
+int64_t tone_mixer_step(tone_mixer_t *m, int64_t now_us, tone_out_t *out);
+
+#ifndef ESP_PLATFORM
+/* Render seqs[v] (NULL = voice unused), each started at start_ms[v], to a
+ * 16-bit mono WAV file. Returns false on I/O error. */
+bool tone_render_wav(const char *path, const tone_seq_t *const seqs[TONE_VOICE_COUNT],
+                     const uint32_t start_ms[TONE_VOICE_COUNT], uint32_t total_ms,
+                     uint32_t sample_rate);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,519 @@
+#include <string.h>
+#include "button_fsm.h"
+#include "ui_fsm.h"
+
+#define ANY   MODE_COUNT   // row matches every mode
+#define SAME  MODE_COUNT   // row keeps the mode
+
+typedef bool (*ui_guard_t)(const ui_t *ui);
+typedef bool (*ui_action_t)(ui_t *ui);   // false = nothing done, mode stays
+
+typedef struct {
+    uint8_t     mode;     // display_mode_t or ANY
+    uint8_t     ev;       // ui_ev_t
+    ui_guard_t  guard;    // NULL = always
+    ui_action_t action;   // NULL = mode change only
+    uint8_t     next;     // display_mode_t or SAME
+    const char *name;
+} ui_row_t;
+
+static inline uint8_t wrap(int v, int lo, int hi) {
+    if (v < lo) return (uint8_t)hi;
+    if (v > hi) return (uint8_t)lo;
+    return (uint8_t)v;
+}
+
+/* ---- guards ---- */
+
+static bool g_ringing(const ui_t *ui)     { return ui->st.ringing; }
+static bool g_sw_running(const ui_t *ui)  { return ui->st.sw == SW_RUNNING; }
+static bool g_sw_reset(const ui_t *ui)    { return ui->st.sw == SW_RESET_SHOWN; }
+static bool g_b4_here(const ui_t *ui)     { return ui->st.b4_from == ui->st.mode; }
+static bool g_has_timers(const ui_t *ui)  { return ui->env->cd_next(ui->ctx, 0) != 0; }
+
+// ringing, and the countdown on screen is the one that ran out
+static bool g_ring_cd_done(const ui_t *ui) {
+    return ui->st.ringing && !ui->env->cd_running(ui->ctx, ui->st.cd_view_id);
+}
+
+/* ---- actions ---- */
+
+static bool a_snooze(ui_t *ui)    { ui->env->snooze(ui->ctx); return true; }
+
+static bool a_stop_ring(ui_t *ui) {
+    ui->st.ringing = false;
+    ui->env->stop_ring(ui->ctx);
+    return true;
+}
+
+static bool a_sw_start(ui_t *ui)  { ui->st.sw = SW_RUNNING; ui->env->sw(ui->ctx, UI_SW_START); return true; }
+static bool a_sw_pause(ui_t *ui)  { ui->st.sw = SW_PAUSED;  ui->env->sw(ui->ctx, UI_SW_PAUSE); return true; }
+static bool a_sw_reset(ui_t *ui)  { ui->st.sw = SW_RESET_SHOWN; ui->env->sw(ui->ctx, UI_SW_RESET); return true; }
+static bool a_sw_lap(ui_t *ui)    { ui->env->sw(ui->ctx, UI_SW_LAP); return true; }
+
+static bool alarm_step(ui_t *ui, int d) {
+    ui_state_t *s = &ui->st;
+    if (s->alarm_sel == ALARM_SEL_HOUR) s->alarm_hour = wrap(s->alarm_hour + d, 0, 23);
+    else                                s->alarm_min  = wrap(s->alarm_min  + d, 0, 59);
+    return true;
+}
+static bool a_alarm_inc(ui_t *ui) { return alarm_step(ui, +1); }
+static bool a_alarm_dec(ui_t *ui) { return alarm_step(ui, -1); }
+
+// a new alarm starts from the current time
+static bool a_alarm_begin(ui_t *ui) {
+    ui->env->now_hm(ui->ctx, &ui->st.alarm_hour, &ui->st.alarm_min);
+    ui->st.alarm_edit_id = 0;
+    ui->st.alarm_sel = ALARM_SEL_HOUR;
+    return true;
+}
+
+static bool a_alarm_field(ui_t *ui) {
+    ui->st.alarm_sel = ui->st.alarm_sel == ALARM_SEL_HOUR ? ALARM_SEL_MIN : ALARM_SEL_HOUR;
+    return true;
+}
+
+static bool a_alarm_save(ui_t *ui) {
+    ui->env->alarm_save(ui->ctx, ui->st.alarm_edit_id, ui->st.alarm_hour, ui->st.alarm_min);
+    ui->env->confirm_beep(ui->ctx);
+    return true;
+}
+
+// step through the stored alarms, then back to a new one
+static bool a_alarm_browse(ui_t *ui) {
+    ui_state_t *s = &ui->st;
+    uint8_t id;
+    if (ui->env->alarm_next(ui->ctx, s->alarm_edit_id, &id, &s->alarm_hour, &s->alarm_min)) {
+        s->alarm_edit_id = id;
+        s->alarm_sel = ALARM_SEL_HOUR;
+        return true;
+    }
+    return a_alarm_begin(ui);
+}
+
+static bool a_alarm_delete(ui_t *ui) {
+    if (!ui->st.alarm_edit_id || !ui->env->alarm_delete(ui->ctx, ui->st.alarm_edit_id)) return false;
+    ui->st.alarm_edit_id = 0;
+    ui->env->confirm_beep(ui->ctx);
+    return true;
+}
+
+static bool cd_step(ui_t *ui, int d) {
+    ui_state_t *s = &ui->st;
+    if (s->cd_sel == CD_SEL_MIN) s->cd_min = wrap(s->cd_min + d, 0, 99);
+    else                         s->cd_sec = wrap(s->cd_sec + d, 0, 59);
+    return true;
+}
+static bool a_cd_inc(ui_t *ui) { return cd_step(ui, +1); }
+static bool a_cd_dec(ui_t *ui) { return cd_step(ui, -1); }
+
+static bool a_cd_setup(ui_t *ui) {
+    ui->st.cd_min = 15; ui->st.cd_sec = 0;
+    ui->st.cd_sel = CD_SEL_MIN;
+    return true;
+}
+
+static bool a_cd_field(ui_t *ui) {
+    ui->st.cd_sel = ui->st.cd_sel == CD_SEL_MIN ? CD_SEL_SEC : CD_SEL_MIN;
+    return true;
+}
+
+static bool a_cd_confirm(ui_t *ui) {
+    int id = ui->env->cd_start(ui->ctx, (uint32_t)ui->st.cd_min * 60 + ui->st.cd_sec);
+    if (id < 0) return false;
+    ui->st.cd_view_id = (uint8_t)id;
+    ui->env->confirm_beep(ui->ctx);
+    return true;
+}
+
+static bool a_cd_view_first(ui_t *ui) {
+    ui->st.cd_view_id = ui->env->cd_next(ui->ctx, 0);
+    return true;
+}
+
+static bool a_cd_view_next(ui_t *ui) {
+    uint8_t id = ui->env->cd_next(ui->ctx, ui->st.cd_view_id);
+    if (!id) return false;
+    ui->st.cd_view_id = id;
+    return true;
+}
+
+static bool a_cd_cancel(ui_t *ui) {
+    if (ui->env->cd_cancel(ui->ctx, ui->st.cd_view_id)) ui->env->confirm_beep(ui->ctx);
+    return true;
+}
+
+/* Rows for the same (mode, event) are tried in table order, so guarded
+ * rows go before the fallback for that pair. */
+static const ui_row_t ROWS[] = {
+    // a ringing alarm takes BTN1, BTN3 and BTN4 first
+    { ANY,                UI_EV_B1_PRESS,  g_ringing,      a_snooze,        SAME,               "snooze" },
+    { ANY,                UI_EV_B3_PRESS,  g_ringing,      a_stop_ring,     SAME,               "stop_ring" },
+    { MODE_COUNTDOWN_RUN, UI_EV_B4_PRESS,  g_ring_cd_done, a_stop_ring,     MODE_TIME,          "stop_ring" },
+    { ANY,                UI_EV_B4_PRESS,  g_ringing,      a_stop_ring,     SAME,               "stop_ring" },
+
+    // BTN1: next view, lap, or up while editing
+    { MODE_TIME,          UI_EV_B1_PRESS,  NULL,           NULL,            MODE_WDAY,          "next" },
+    { MODE_WDAY,          UI_EV_B1_PRESS,  NULL,           NULL,            MODE_DDMM,          "next" },
+    { MODE_DDMM,          UI_EV_B1_PRESS,  NULL,           NULL,            MODE_YYYY,          "next" },
+    { MODE_YYYY,          UI_EV_B1_PRESS,  NULL,           NULL,            MODE_DHT,           "next" },
+    { MODE_DHT,           UI_EV_B1_PRESS,  NULL,           NULL,            MODE_TIME,          "next" },
+    { MODE_SW,            UI_EV_B1_PRESS,  g_sw_running,   a_sw_lap,        SAME,               "sw_lap" },
+    { MODE_SW,            UI_EV_B1_PRESS,  NULL,           NULL,            MODE_TIME,          "leave" },
+    { MODE_COUNTDOWN_RUN, UI_EV_B1_PRESS,  NULL,           NULL,            MODE_TIME,          "leave" },
+    { MODE_ALARM_SET,     UI_EV_B1_PRESS,  NULL,           a_alarm_inc,     SAME,               "alarm_inc" },
+    { MODE_ALARM_SET,     UI_EV_B1_REPEAT, NULL,           a_alarm_inc,     SAME,               "alarm_inc" },
+    { MODE_COUNTDOWN_SET, UI_EV_B1_PRESS,  NULL,           a_cd_inc,        SAME,               "cd_inc" },
+    { MODE_COUNTDOWN_SET, UI_EV_B1_REPEAT, NULL,           a_cd_inc,        SAME,               "cd_inc" },
+
+    // BTN2: stopwatch start/pause/reset, down while editing, next timer
+    { MODE_ALARM_SET,     UI_EV_B2_PRESS,  NULL,           a_alarm_dec,     SAME,               "alarm_dec" },
+    { MODE_ALARM_SET,     UI_EV_B2_REPEAT, NULL,           a_alarm_dec,     SAME,               "alarm_dec" },
+    { MODE_COUNTDOWN_SET, UI_EV_B2_PRESS,  NULL,           a_cd_dec,        SAME,               "cd_dec" },
+    { MODE_COUNTDOWN_SET, UI_EV_B2_REPEAT, NULL,           a_cd_dec,        SAME,               "cd_dec" },
+    { MODE_COUNTDOWN_RUN, UI_EV_B2_PRESS,  NULL,           a_cd_view_next,  SAME,               "cd_view_next" },
+    { MODE_SW,            UI_EV_B2_PRESS,  g_sw_reset,     a_sw_start,      SAME,               "sw_start" },
+    { MODE_SW,            UI_EV_B2_PRESS,  g_sw_running,   a_sw_pause,      SAME,               "sw_pause" },
+    { MODE_SW,            UI_EV_B2_PRESS,  NULL,           a_sw_reset,      SAME,               "sw_reset" },
+    { MODE_SW,            UI_EV_B2_DOUBLE, NULL,           a_sw_reset,      SAME,               "sw_reset" },
+    { ANY,                UI_EV_B2_PRESS,  NULL,           a_sw_reset,      MODE_SW,            "sw_enter" },
+
+    // BTN3: alarm edit, field toggle, long-press saves
+    { MODE_ALARM_SET,     UI_EV_B3_PRESS,  NULL,           a_alarm_field,   SAME,               "alarm_field" },
+    { ANY,                UI_EV_B3_PRESS,  NULL,           a_alarm_begin,   MODE_ALARM_SET,     "alarm_begin" },
+    { MODE_ALARM_SET,     UI_EV_B3_LONG,   NULL,           a_alarm_save,    MODE_TIME,          "alarm_save" },
+
+    // BTN4: countdowns; in alarm edit it browses (tap) and deletes (long)
+    { MODE_ALARM_SET,     UI_EV_B4_PRESS,  NULL,           NULL,            SAME,               "arm" },
+    { MODE_COUNTDOWN_RUN, UI_EV_B4_PRESS,  NULL,           NULL,            SAME,               "arm" },
+    { MODE_COUNTDOWN_SET, UI_EV_B4_PRESS,  NULL,           a_cd_field,      SAME,               "cd_field" },
+    { ANY,                UI_EV_B4_PRESS,  g_has_timers,   a_cd_view_first, MODE_COUNTDOWN_RUN, "cd_view" },
+    { ANY,                UI_EV_B4_PRESS,  NULL,           a_cd_setup,      MODE_COUNTDOWN_SET, "cd_setup" },
+    { MODE_ALARM_SET,     UI_EV_B4_TAP,    g_b4_here,      a_alarm_browse,  SAME,               "alarm_browse" },
+    { MODE_ALARM_SET,     UI_EV_B4_LONG,   g_b4_here,      a_alarm_delete,  MODE_TIME,          "alarm_delete" },
+    { MODE_COUNTDOWN_RUN, UI_EV_B4_TAP,    g_b4_here,      a_cd_setup,      MODE_COUNTDOWN_SET, "cd_setup" },
+    { MODE_COUNTDOWN_RUN, UI_EV_B4_LONG,   g_b4_here,      a_cd_cancel,     MODE_TIME,          "cd_cancel" },
+    { MODE_COUNTDOWN_SET, UI_EV_B4_LONG,   NULL,           a_cd_confirm,    MODE_COUNTDOWN_RUN, "cd_confirm" },
+};
+#define ROW_COUNT (sizeof(ROWS) / sizeof(ROWS[0]))
+
+/* Candidate rows per (mode, event) as row index + 1, 0 after the last;
+ * built once so dispatch never scans the table. Rows behind an unguarded
+ * one can never run and are left out. */
+#define UI_CAND_MAX 4
+static uint8_t s_cand[MODE_COUNT][UI_EV_COUNT][UI_CAND_MAX];
+static bool s_cand_built = false;
+
+static void build_index(void)
+{
+    memset(s_cand, 0, sizeof(s_cand));
+    for (unsigned r = 0; r < ROW_COUNT; ++r) {
+        for (int m = 0; m < MODE_COUNT; ++m) {
+            if (ROWS[r].mode != ANY && ROWS[r].mode != m) continue;
+            uint8_t *c = s_cand[m][ROWS[r].ev];
+            int k = 0;
+            while (k < UI_CAND_MAX && c[k] && ROWS[c[k] - 1].guard) ++k;
+            if (k < UI_CAND_MAX && !c[k]) c[k] = (uint8_t)(r + 1);
+        }
+    }
+    s_cand_built = true;
+}
+
+void ui_init(ui_t *ui, const ui_env_t *env, void *ctx)
+{
+    if (!s_cand_built) build_index();
+    memset(ui, 0, sizeof(*ui));
+    ui->env = env;
+    ui->ctx = ctx;
+    ui->st.mode = MODE_TIME;
+    ui->st.alarm_hour = 7;
+    ui->st.cd_min = 15;
+    ui->st.b4_from = MODE_COUNT;
+}
+
+const char *ui_dispatch(ui_t *ui, ui_ev_t ev)
+{
+    if ((unsigned)ev >= UI_EV_COUNT || (unsigned)ui->st.mode >= MODE_COUNT) return NULL;
+    if (ev == UI_EV_B4_PRESS) ui->st.b4_from = ui->st.ringing ? MODE_COUNT : ui->st.mode;
+
+    const uint8_t *c = s_cand[ui->st.mode][ev];
+    for (int k = 0; k < UI_CAND_MAX && c[k]; ++k) {
+        const ui_row_t *r = &ROWS[c[k] - 1];
+        if (r->guard && !r->guard(ui)) continue;
+        if (r->action && !r->action(ui)) return NULL;
+        if (r->next != SAME) ui->st.mode = (display_mode_t)r->next;
+        return r->name;
+    }
+    return NULL;
+}
+
+ui_ev_t ui_ev_from_button(uint8_t btn, uint8_t type, uint32_t held_ms)
+{
+    switch (btn) {
+    case 0:
+        if (type == BTN_EV_PRESS)  return UI_EV_B1_PRESS;
+        if (type == BTN_EV_REPEAT) return UI_EV_B1_REPEAT;
+        break;
+    case 1:
+        if (type == BTN_EV_PRESS)  return UI_EV_B2_PRESS;
+        if (type == BTN_EV_REPEAT) return UI_EV_B2_REPEAT;
+        if (type == BTN_EV_DOUBLE) return UI_EV_B2_DOUBLE;
+        break;
+    case 2:
+        if (type == BTN_EV_PRESS)  return UI_EV_B3_PRESS;
+        if (type == BTN_EV_LONG)   return UI_EV_B3_LONG;
+        break;
+    case 3:
+        if (type == BTN_EV_PRESS)  return UI_EV_B4_PRESS;
+        if (type == BTN_EV_LONG)   return UI_EV_B4_LONG;
+        // a release after the long-press already acted is ignored
+        if (type == BTN_EV_RELEASE && (int64_t)held_ms * 1000 < BTN_LONG_US) return UI_EV_B4_TAP;
+        break;
+    default:
+        break;
+    }
+    return UI_EV_NONE;
+}
+
+static const char *const EV_NAMES[UI_EV_COUNT] = {
+    "b1.press", "b1.repeat", "b2.press", "b2.repeat", "b2.double",
+    "b3.press", "b3.long", "b4.press", "b4.tap", "b4.long",
+};
+
+static const char *const MODE_NAMES[MODE_COUNT] = {
+    "TIME", "WDAY", "DDMM", "YYYY", "DHT", "SW", "ALARM_SET", "CD_SET", "CD_RUN",
+};
+
+const char *ui_ev_name(ui_ev_t ev)
+{
+    return (unsigned)ev < UI_EV_COUNT ? EV_NAMES[ev] : "none";
+}
+
+const char *ui_mode_name(display_mode_t mode)
+{
+    return (unsigned)mode < MODE_COUNT ? MODE_NAMES[mode] : "?";
+}
+
+#ifndef ESP_PLATFORM
+#include <stdlib.h>
+#include <time.h>
+
+/* Stand-ins for the alarm table, countdowns and clock. */
+#define MOCK_ALARMS 8
+#define MOCK_TIMERS 8
+
+typedef struct {
+    uint8_t hour, min;
+    uint8_t alarm_id[MOCK_ALARMS], alarm_h[MOCK_ALARMS], alarm_m[MOCK_ALARMS];
+    bool    timer[MOCK_TIMERS + 1];   // by id, 1-based
+} mock_t;
+
+static void m_nop(void *ctx) { (void)ctx; }
+static void m_sw(void *ctx, ui_sw_op_t op) { (void)ctx; (void)op; }
+static void m_now(void *ctx, uint8_t *h, uint8_t *m) { *h = ((mock_t *)ctx)->hour; *m = ((mock_t *)ctx)->min; }
+
+static bool m_alarm_save(void *ctx, uint8_t id, uint8_t h, uint8_t m)
+{
+    mock_t *k = ctx;
+    int slot = -1, top = 0;
+    for (int i = 0; i < MOCK_ALARMS; ++i) {
+        if (id && k->alarm_id[i] == id) slot = i;
+        if (k->alarm_id[i] > top) top = k->alarm_id[i];
+    }
+    if (slot < 0) {
+        for (int i = 0; i < MOCK_ALARMS && slot < 0; ++i) if (!k->alarm_id[i]) slot = i;
+        if (slot < 0) return false;
+        k->alarm_id[slot] = (uint8_t)(top + 1);
+    }
+    k->alarm_h[slot] = h; k->alarm_m[slot] = m;
+    return true;
+}
+
+static bool m_alarm_delete(void *ctx, uint8_t id)
+{
+    mock_t *k = ctx;
+    for (int i = 0; i < MOCK_ALARMS; ++i)
+        if (k->alarm_id[i] == id) { k->alarm_id[i] = 0; return true; }
+    return false;
+}
+
+static bool m_alarm_next(void *ctx, uint8_t after, uint8_t *id, uint8_t *h, uint8_t *m)
+{
+    mock_t *k = ctx;
+    int best = -1;
+    for (int i = 0; i < MOCK_ALARMS; ++i)
+        if (k->alarm_id[i] > after && (best < 0 || k->alarm_id[i] < k->alarm_id[best])) best = i;
+    if (best < 0) return false;
+    *id = k->alarm_id[best]; *h = k->alarm_h[best]; *m = k->alarm_m[best];
+    return true;
+}
+
+static int m_cd_start(void *ctx, uint32_t s)
+{
+    mock_t *k = ctx;
+    (void)s;
+    for (int id = 1; id <= MOCK_TIMERS; ++id)
+        if (!k->timer[id]) { k->timer[id] = true; return id; }
+    return -1;
+}
+
+static bool m_cd_cancel(void *ctx, uint8_t id)
+{
+    mock_t *k = ctx;
+    if (id == 0 || id > MOCK_TIMERS || !k->timer[id]) return false;
+    k->timer[id] = false;
+    return true;
+}
+
+static bool m_cd_running(void *ctx, uint8_t id)
+{
+    return id && id <= MOCK_TIMERS && ((mock_t *)ctx)->timer[id];
+}
+
+static uint8_t m_cd_next(void *ctx, uint8_t after)
+{
+    mock_t *k = ctx;
+    for (int id = after + 1; id <= MOCK_TIMERS; ++id) if (k->timer[id]) return (uint8_t)id;
+    for (int id = 1; id <= after && id <= MOCK_TIMERS; ++id) if (k->timer[id]) return (uint8_t)id;
+    return 0;
+}
+
+static const ui_env_t MOCK_ENV = {
+    .stop_ring = m_nop, .snooze = m_nop, .confirm_beep = m_nop,
+    .now_hm = m_now, .sw = m_sw,
+    .alarm_save = m_alarm_save, .alarm_delete = m_alarm_delete, .alarm_next = m_alarm_next,
+    .cd_start = m_cd_start, .cd_cancel = m_cd_cancel, .cd_running = m_cd_running, .cd_next = m_cd_next,
+};
+
+static int count_alarms(const mock_t *k)
+{
+    int n = 0;
+    for (int i = 0; i < MOCK_ALARMS; ++i) n += k->alarm_id[i] != 0;
+    return n;
+}
+
+static int count_timers(const mock_t *k)
+{
+    int n = 0;
+    for (int id = 1; id <= MOCK_TIMERS; ++id) n += k->timer[id];
+    return n;
+}
+
+// one "k=v" against the state; returns false and reports on mismatch
+static bool check(const ui_t *ui, const mock_t *k, const char *kv, int line, FILE *out)
+{
+    static const char *const SW[] = { "reset", "run", "pause" };
+    const ui_state_t *s = &ui->st;
+    char got[16];
+    const char *eq = strchr(kv, '=');
+    if (!eq) { fprintf(out, "%d: bad expect '%s'\n", line, kv); return false; }
+    size_t kl = (size_t)(eq - kv);
+    const char *want = eq + 1;
+
+#define KEY(name) (kl == strlen(name) && !strncmp(kv, name, kl))
+    if      (KEY("mode"))   snprintf(got, sizeof(got), "%s", ui_mode_name(s->mode));
+    else if (KEY("sw"))     snprintf(got, sizeof(got), "%s", SW[s->sw]);
+    else if (KEY("alarm"))  snprintf(got, sizeof(got), "%02u:%02u", s->alarm_hour, s->alarm_min);
+    else if (KEY("sel"))    snprintf(got, sizeof(got), "%s", s->alarm_sel == ALARM_SEL_HOUR ? "hour" : "min");
+    else if (KEY("cd"))     snprintf(got, sizeof(got), "%02u:%02u", s->cd_min, s->cd_sec);
+    else if (KEY("cdsel"))  snprintf(got, sizeof(got), "%s", s->cd_sel == CD_SEL_MIN ? "min" : "sec");
+    else if (KEY("edit"))   snprintf(got, sizeof(got), "%u", s->alarm_edit_id);
+    else if (KEY("view"))   snprintf(got, sizeof(got), "%u", s->cd_view_id);
+    else if (KEY("alarms")) snprintf(got, sizeof(got), "%d", count_alarms(k));
+    else if (KEY("timers")) snprintf(got, sizeof(got), "%d", count_timers(k));
+    else if (KEY("ring"))   snprintf(got, sizeof(got), "%s", s->ringing ? "on" : "off");
+    else { fprintf(out, "%d: unknown key '%.*s'\n", line, (int)kl, kv); return false; }
+#undef KEY
+
+    if (strcmp(got, want) == 0) return true;
+    fprintf(out, "%d: %.*s is %s, expected %s\n", line, (int)kl, kv, got, want);
+    return false;
+}
+
+static void bench(long n, FILE *out)
+{
+    // every event in turn: walks most modes and both guard outcomes
+    mock_t k = { .hour = 7 };
+    ui_t ui;
+    ui_init(&ui, &MOCK_ENV, &k);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < n; ++i) (void)ui_dispatch(&ui, (ui_ev_t)(i % UI_EV_COUNT));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    fprintf(out, "bench: %ld events, %.1f ns/event (mock side effects included)\n", n, ns / n);
+}
+
+int ui_replay(FILE *in, FILE *out)
+{
+    mock_t k = { .hour = 7 };
+    ui_t ui;
+    ui_init(&ui, &MOCK_ENV, &k);
+
+    char buf[256];
+    int line = 0, fails = 0;
+    while (fgets(buf, sizeof(buf), in)) {
+        ++line;
+        char *p = strstr(buf, "ui> ");
+        bool logged = p != NULL;
+        p = logged ? p + 4 : buf;
+        p[strcspn(p, "#\r\n")] = 0;
+        char *tok = strtok(p, " \t");
+        if (!tok) continue;
+
+        if (!strcmp(tok, "time")) {
+            unsigned h, m;
+            char *a = strtok(NULL, " \t");
+            if (!a || sscanf(a, "%u:%u", &h, &m) != 2 || h > 23 || m > 59) goto bad;
+            k.hour = (uint8_t)h; k.min = (uint8_t)m;
+        } else if (!strcmp(tok, "ring")) {
+            char *a = strtok(NULL, " \t");
+            if (!a) goto bad;
+            ui.st.ringing = !strcmp(a, "on");
+        } else if (!strcmp(tok, "cd_done")) {
+            char *a = strtok(NULL, " \t");
+            long id = a ? strtol(a, NULL, 10) : 0;
+            if (id < 1 || id > MOCK_TIMERS) goto bad;
+            k.timer[id] = false;
+        } else if (!strcmp(tok, "expect")) {
+            for (char *kv; (kv = strtok(NULL, " \t")); )
+                if (!check(&ui, &k, kv, line, out)) ++fails;
+        } else if (!strcmp(tok, "bench")) {
+            char *a = strtok(NULL, " \t");
+            long n = a ? strtol(a, NULL, 10) : 0;
+            if (n <= 0) goto bad;
+            bench(n, out);
+        } else {
+            ui_ev_t ev = UI_EV_NONE;
+            for (int i = 0; i < UI_EV_COUNT; ++i) if (!strcmp(tok, EV_NAMES[i])) ev = (ui_ev_t)i;
+            if (ev == UI_EV_NONE) {
+                if (!logged) continue;   // the rest of a monitor log
+                goto bad;
+            }
+            display_mode_t from = ui.st.mode;
+            const char *act = ui_dispatch(&ui, ev);
+            fprintf(out, "%-10s %-9s -> %-9s %s\n", tok, ui_mode_name(from),
+                    ui_mode_name(ui.st.mode), act ? act : "-");
+        }
+        continue;
+bad:
+        fprintf(out, "%d: cannot parse\n", line);
+        return -1;
+    }
+    return fails;
+}
+
+#ifdef UI_REPLAY_MAIN
+/* cc -DUI_REPLAY_MAIN -Imain main/ui_fsm.c -o ui_replay && ./ui_replay main/ui_trace.txt
+ * With no file the trace is read from stdin. Exit status 1 on any failed expect. */
+int main(int argc, char **argv)
+{
+    FILE *in = argc > 1 ? fopen(argv[1], "r") : stdin;
+    if (!in) { perror(argv[1]); return 2; }
+    int fails = ui_replay(in, stdout);
+    if (fails < 0) return 2;
+    printf("%s (%d failed)\n", fails ? "FAIL" : "OK", fails);
+    return fails ? 1 : 0;
+}
+#endif
+#endif
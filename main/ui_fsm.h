@@ -0,0 +1,126 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* UI modes as a transition table: each (mode, event) pair maps to a short
+ * list of rows {guard, action, next mode}, and the first row whose guard
+ * passes runs. Plain C; the firmware and the off-target replay tool
+ * supply the side effects through ui_env_t. */
+
+typedef enum {
+    MODE_TIME = 0,
+    MODE_WDAY,
+    MODE_DDMM,
+    MODE_YYYY,
+    MODE_DHT,
+    MODE_SW,
+    MODE_ALARM_SET,
+    MODE_COUNTDOWN_SET,
+    MODE_COUNTDOWN_RUN,
+    MODE_COUNT
+} display_mode_t;
+
+typedef enum {
+    SW_RESET_SHOWN = 0,
+    SW_RUNNING,
+    SW_PAUSED
+} sw_state_t;
+
+typedef enum {
+    ALARM_SEL_HOUR = 0,
+    ALARM_SEL_MIN
+} alarm_sel_t;
+
+typedef enum {
+    CD_SEL_MIN = 0,
+    CD_SEL_SEC
+} countdown_sel_t;
+
+typedef enum {
+    UI_EV_B1_PRESS = 0,
+    UI_EV_B1_REPEAT,
+    UI_EV_B2_PRESS,
+    UI_EV_B2_REPEAT,
+    UI_EV_B2_DOUBLE,
+    UI_EV_B3_PRESS,
+    UI_EV_B3_LONG,
+    UI_EV_B4_PRESS,
+    UI_EV_B4_TAP,      // released before a long-press
+    UI_EV_B4_LONG,
+    UI_EV_COUNT,
+    UI_EV_NONE = UI_EV_COUNT
+} ui_ev_t;
+
+typedef struct {
+    display_mode_t  mode;
+    sw_state_t      sw;
+    alarm_sel_t     alarm_sel;
+    countdown_sel_t cd_sel;
+    uint8_t alarm_hour, alarm_min;
+    uint8_t alarm_edit_id;      // alarm being edited, 0 = new
+    uint8_t cd_min, cd_sec;
+    uint8_t cd_view_id;         // countdown shown in MODE_COUNTDOWN_RUN
+    uint8_t b4_from;            // mode BTN4 went down in, MODE_COUNT while ringing
+    bool    ringing;            // owned by the alarm side, refreshed before dispatch
+} ui_state_t;
+
+typedef enum { UI_SW_START, UI_SW_PAUSE, UI_SW_RESET, UI_SW_LAP } ui_sw_op_t;
+
+typedef struct {
+    void (*stop_ring)(void *ctx);
+    void (*snooze)(void *ctx);
+    void (*confirm_beep)(void *ctx);
+    void (*now_hm)(void *ctx, uint8_t *hour, uint8_t *min);
+    void (*sw)(void *ctx, ui_sw_op_t op);
+    // edit_id 0 adds a new daily alarm; returns false if nothing was stored
+    bool (*alarm_save)(void *ctx, uint8_t edit_id, uint8_t hour, uint8_t min);
+    bool (*alarm_delete)(void *ctx, uint8_t id);
+    // lowest id above after_id; false when there is none
+    bool (*alarm_next)(void *ctx, uint8_t after_id, uint8_t *id, uint8_t *hour, uint8_t *min);
+    int  (*cd_start)(void *ctx, uint32_t seconds);    // id, or -1
+    bool (*cd_cancel)(void *ctx, uint8_t id);
+    bool (*cd_running)(void *ctx, uint8_t id);
+    // lowest running id above after_id, wrapping to the first; 0 = none running
+    uint8_t (*cd_next)(void *ctx, uint8_t after_id);
+} ui_env_t;
+
+typedef struct {
+    ui_state_t st;
+    const ui_env_t *env;
+    void *ctx;
+} ui_t;
+
+void ui_init(ui_t *ui, const ui_env_t *env, void *ctx);
+
+/* Run the first matching row for ev. Returns the action's name, or NULL
+ * when no row applied and nothing changed. */
+const char *ui_dispatch(ui_t *ui, ui_ev_t ev);
+
+// BTN_EV_* from button_fsm.h for button 0..3, or UI_EV_NONE if the UI ignores it
+ui_ev_t ui_ev_from_button(uint8_t btn, uint8_t type, uint32_t held_ms);
+
+const char *ui_ev_name(ui_ev_t ev);
+const char *ui_mode_name(display_mode_t mode);
+
+#ifndef ESP_PLATFORM
+#include <stdio.h>
+/* Replay a trace: one event name per line, plus directives. Text before
+ * "ui> " is skipped and other lines that start with neither an event nor
+ * a directive are ignored, so firmware logs work as is.
+ *   time HH:MM        clock the mock reads
+ *   ring on|off       alarm ringing
+ *   cd_done ID        countdown ID ran out
+ *   expect k=v ...    mode, sw, alarm (HH:MM), sel, cd (MM:SS), cdsel,
+ *                     edit, view, alarms, timers, ring
+ *   bench N           time N dispatches of a fixed event mix
+ * Returns the number of failed expectations, -1 on a parse error. */
+int ui_replay(FILE *in, FILE *out);
+#endif
+
+#ifdef __cplusplus
+}
+#endif